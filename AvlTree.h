@@ -0,0 +1,498 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "SetProbes.h"
+
+// AVL-tree algorithms shared by Set, IntrusiveSet and StaticSet. https://en.wikipedia.org/wiki/AVL_tree
+// The algorithms operate on hook links only, the containers decide where the hooks live: Set embeds a hook in
+// every allocated vertex, IntrusiveSet uses hooks embedded in the user objects, StaticSet keeps hooks with relative
+// links in an array.
+// Every tree contains an end vertex (is_end == true) greater than all the other vertices, it serves as the
+// past-the-end position of the iterators.
+
+// Links of a tree vertex.
+struct AvlHook {
+    size_t height = 1;
+    AvlHook* left_son = nullptr;
+    AvlHook* right_son = nullptr;
+    AvlHook* parent = nullptr;
+    bool is_end = false;
+};
+
+// Links of a tree vertex without the parent link. Saves a pointer per vertex and the parent updates in rotations,
+// but iterators have to keep the whole path from the root (AvlPath).
+struct AvlParentlessHook {
+    size_t height = 1;
+    AvlParentlessHook* left_son = nullptr;
+    AvlParentlessHook* right_son = nullptr;
+    bool is_end = false;
+};
+
+// Link stored as the distance in bytes from the link to the target hook, zero for null (no hook links to itself).
+// The links between hooks in one block of memory stay valid when the block is copied as a whole, and they take
+// 2 or 4 bytes instead of a pointer. A link behaves like a Hook*: it converts to one and assigning one stores the
+// distance, so the tree algorithms work on it unchanged. Copying a link copies the target, CopyRaw copies the distance.
+template<class Hook, class Offset>
+class AvlRelativeLink {
+public:
+    AvlRelativeLink() = default;
+    AvlRelativeLink(const AvlRelativeLink& link) {
+        *this = link.get();
+    }
+    AvlRelativeLink& operator=(const AvlRelativeLink& link) {
+        return *this = link.get();
+    }
+    AvlRelativeLink& operator=(Hook* v) {
+        offset_ = v == nullptr ? 0 : static_cast<Offset>(reinterpret_cast<char*>(v) - Address());
+        return *this;
+    }
+    operator Hook*() const {
+        return get();
+    }
+    Hook* operator->() const {
+        return get();
+    }
+    Hook* get() const {
+        return offset_ == 0 ? nullptr : reinterpret_cast<Hook*>(Address() + offset_);
+    }
+    // Copies the distance of the given link, for copying the hooks of one block to a block of the same layout.
+    void CopyRaw(const AvlRelativeLink& link) {
+        offset_ = link.offset_;
+    }
+private:
+    char* Address() const {
+        return const_cast<char*>(reinterpret_cast<const char*>(this));
+    }
+
+    Offset offset_;  // Left uninitialized, so that arrays of hooks are not written on construction.
+};
+
+// Links of a tree vertex as relative links (AvlRelativeLink) with the given signed offset type. The fields are not
+// initialized by the constructor.
+template<class Offset>
+struct AvlRelativeHook {
+    using Link = AvlRelativeLink<AvlRelativeHook, Offset>;
+    Link left_son;
+    Link right_son;
+    Link parent;
+    uint8_t height;
+    bool is_end;
+};
+
+// Receives the events of the tree algorithms: OnVisit with every vertex on the way down of a search, OnRotation for
+// every single or double rotation. The default observer ignores them; it is an empty type passed by value, so it
+// costs nothing. Key comparisons are observed through the KeyOf functors, which are called once per comparison.
+struct AvlNullObserver {
+    template<class Hook>
+    void OnVisit(const Hook* /* v */) const {
+    }
+    void OnRotation(bool /* is_double */) const {
+    }
+};
+
+// Path from the root to a vertex, the last element is the vertex itself.
+template<class Hook>
+struct AvlPath {
+    // AVL-tree of height h has at least F(h + 2) - 1 vertices (Fibonacci numbers): height 65 takes F(67) - 1, about
+    // 4.5e13 vertices of at least 24 bytes, i.e. about 1 PB. The count fits in size_t, the bound holds because that
+    // exceeds the 128 TiB of user address space with 4-level paging (and any real memory with 5-level paging).
+    // Push asserts it.
+    static constexpr size_t kMaxHeight = 64;
+    const Hook* vertices[kMaxHeight];
+    size_t depth = 0;
+
+    void Push(const Hook* v) {
+        assert(depth < kMaxHeight);
+        vertices[depth++] = v;
+    }
+    const Hook* Top() const {
+        return vertices[depth - 1];
+    }
+};
+
+template<class Hook>
+class AvlTree {
+public:
+    static constexpr bool kParentLinks = !std::is_same<Hook, AvlParentlessHook>::value;
+
+    // Returns the end vertex for a new tree.
+    static Hook MakeEnd() {
+        Hook end;
+        end.is_end = true;
+        return end;
+    }
+    // Sets the parent link of a vertex, if the hooks have it.
+    static void SetParent(Hook* v, Hook* parent) {
+        if constexpr (kParentLinks) {
+            v->parent = parent;
+        }
+    }
+    // Returns height of a tree vertex.
+    static size_t GetHeight(const Hook* v) {
+        if (v != nullptr) {
+            return v->height;
+        }
+        return 0;
+    }
+    // Returns balance factor of a tree vertex.
+    static int32_t GetBalance(const Hook* v) {
+        if (v != nullptr) {
+            return GetHeight(v->left_son) - GetHeight(v->right_son);
+        }
+        return 0;
+    }
+    // Fixes height field of a vertex, if it is not correct.
+    static void FixHeight(Hook* v) {
+        if (v != nullptr) {
+            v->height = std::max(GetHeight(v->left_son), GetHeight(v->right_son)) + 1;
+        }
+    }
+    // Next two methods implement right and left_son rotation of a vertex to rebalance the tree. Complexity O(1).
+    static Hook* RightRotation(Hook* v) {
+        Hook* q = v->left_son;
+        v->left_son = q->right_son;
+        if (v->left_son != nullptr) {
+            SetParent(v->left_son, v);
+        }
+        q->right_son = v;
+        if constexpr (kParentLinks) {
+            q->parent = v->parent;
+            v->parent = q;
+        }
+        FixHeight(v);
+        FixHeight(q);
+        return q;
+    }
+    static Hook* LeftRotation(Hook* v) {
+        Hook* q = v->right_son;
+        v->right_son = q->left_son;
+        if (v->right_son != nullptr) {
+            SetParent(v->right_son, v);
+        }
+        q->left_son = v;
+        if constexpr (kParentLinks) {
+            q->parent = v->parent;
+            v->parent = q;
+        }
+        FixHeight(v);
+        FixHeight(q);
+        return q;
+    }
+    // Fixes the tree if the current vertex needs to be rebalanced. Complexity O(1).
+    template<class Observer = AvlNullObserver>
+    static Hook* FixBalance(Hook* v, Observer observer = Observer()) {
+        if (v == nullptr) {
+            return nullptr;
+        }
+        FixHeight(v);
+        if (GetBalance(v) == -2) {
+            bool is_double = GetBalance(v->right_son) > 0;
+            if (is_double) {
+                v->right_son = RightRotation(v->right_son);
+            }
+            observer.OnRotation(is_double);
+            SET_TEMPLATE_PROBE2(rotation, v, is_double);
+            v = LeftRotation(v);
+            return v;
+        }
+        if (GetBalance(v) == 2) {
+            bool is_double = GetBalance(v->left_son) < 0;
+            if (is_double) {
+                v->left_son = LeftRotation(v->left_son);
+            }
+            observer.OnRotation(is_double);
+            SET_TEMPLATE_PROBE2(rotation, v, is_double);
+            v = RightRotation(v);
+            return v;
+        }
+        return v;
+    }
+    // Links the vertex n with the key k into the tree. KeyOf maps a vertex, which is not the end vertex, to its key.
+    // Complexity O(log n).
+    template<class K, class KeyOf, class Observer = AvlNullObserver>
+    static Hook* Insert(Hook* v, Hook* n, Hook* parent, const K& k, KeyOf key_of, Observer observer = Observer()) {
+        if (v == nullptr) {
+            n->height = 1;
+            n->left_son = nullptr;
+            n->right_son = nullptr;
+            SetParent(n, parent);
+            return n;
+        }
+        observer.OnVisit(v);
+        if (v->is_end || k < key_of(v)) {
+            v->left_son = Insert(v->left_son, n, v, k, key_of, observer);
+        } else {
+            v->right_son = Insert(v->right_son, n, v, k, key_of, observer);
+        }
+        v = FixBalance(v, observer);
+        return v;
+    }
+    // Erases minimal element in the subtree of the current vertex, whose parent is given. Complexity O(log n).
+    template<class Observer = AvlNullObserver>
+    static Hook* EraseMin(Hook* v, Hook* parent, Observer observer = Observer()) {
+        if (v->left_son == nullptr) {
+            if (v->right_son != nullptr) {
+                SetParent(v->right_son, parent);
+            }
+            return v->right_son;
+        }
+        v->left_son = EraseMin(v->left_son, v, observer);
+        v = FixBalance(v, observer);
+        return v;
+    }
+    // Unlinks the vertex with the given key value from the subtree of v, whose parent is given, and stores it to
+    // erased, or does nothing if such vertex does not exist. Returns the new root of the subtree. Complexity O(log n).
+    template<class K, class KeyOf, class Observer = AvlNullObserver>
+    static Hook* Erase(Hook* v, Hook* parent, const K& k, KeyOf key_of, Hook*& erased,
+                       Observer observer = Observer()) {
+        if (v == nullptr) {
+            return nullptr;
+        }
+        observer.OnVisit(v);
+        if (v->is_end || k < key_of(v)) {
+            v->left_son = Erase(v->left_son, v, k, key_of, erased, observer);
+        } else if (key_of(v) < k) {
+            v->right_son = Erase(v->right_son, v, k, key_of, erased, observer);
+        } else {
+            erased = v;
+            Hook* l = v->left_son;
+            Hook* r = v->right_son;
+            if (r == nullptr) {
+                if (l != nullptr) {
+                    SetParent(l, parent);
+                }
+                return l;
+            }
+            Hook* minnode = FindMin(r);
+            minnode->right_son = EraseMin(r, minnode, observer);
+            SetParent(minnode, parent);
+            minnode->left_son = l;
+            if (minnode->left_son != nullptr) {
+                SetParent(minnode->left_son, minnode);
+            }
+            if (minnode->right_son != nullptr) {
+                SetParent(minnode->right_son, minnode);
+            }
+            minnode = FixBalance(minnode, observer);
+            return minnode;
+        }
+        v = FixBalance(v, observer);
+        return v;
+    }
+    // Unlinks the vertex v from the tree with the given root, no key comparisons are made. Needs parent links.
+    // Returns the new root of the tree. Complexity O(log n).
+    static Hook* Unlink(Hook* root, Hook* v) {
+        static_assert(kParentLinks, "Unlink needs parent links");
+        Hook* retrace;
+        Hook* l = v->left_son;
+        Hook* r = v->right_son;
+        if (l != nullptr && r != nullptr) {
+            Hook* minnode = FindMin(r);
+            if (minnode != r) {
+                retrace = minnode->parent;
+                retrace->left_son = minnode->right_son;
+                if (minnode->right_son != nullptr) {
+                    minnode->right_son->parent = retrace;
+                }
+                minnode->right_son = r;
+                r->parent = minnode;
+            } else {
+                retrace = minnode;
+            }
+            minnode->left_son = l;
+            l->parent = minnode;
+            minnode->height = v->height;
+            root = ReplaceSon(root, v->parent, v, minnode);
+        } else {
+            retrace = v->parent;
+            root = ReplaceSon(root, v->parent, v, l != nullptr ? l : r);
+        }
+        while (retrace != nullptr) {
+            Hook* parent = retrace->parent;
+            root = ReplaceSon(root, parent, retrace, FixBalance(retrace));
+            retrace = parent;
+        }
+        return root;
+    }
+    // Finds minimal element in the subtree of a current vertex. Complexity O(log n).
+    template<class HookPtr>
+    static HookPtr FindMin(HookPtr v) {
+        while (v->left_son != nullptr) {
+            v = v->left_son;
+        }
+        return v;
+    }
+    // Finds maximal element in the subtree of a current vertex. Complexity O(log n).
+    template<class HookPtr>
+    static HookPtr FindEnd(HookPtr v) {
+        while (v->right_son != nullptr) {
+            v = v->right_son;
+        }
+        return v;
+    }
+    // Finds a vertex with the given key value or returns nullptr if such vertex does not exist. Complexity O(log n).
+    template<class K, class KeyOf, class Observer = AvlNullObserver>
+    static Hook* Find(Hook* v, const K& k, KeyOf key_of, Observer observer = Observer()) {
+        if (v == nullptr) {
+            return nullptr;
+        }
+        observer.OnVisit(v);
+        if (v->is_end || k < key_of(v)) {
+            return Find(v->left_son, k, key_of, observer);
+        } else if (key_of(v) < k) {
+            return Find(v->right_son, k, key_of, observer);
+        }
+        return v;
+    }
+    // Finds a vertex with the minimal value more or equal to the given key value. Complexity O(log n).
+    template<class K, class KeyOf, class Observer = AvlNullObserver>
+    static Hook* LowerBound(Hook* v, Hook* par, const K& k, KeyOf key_of, Observer observer = Observer()) {
+        if (v == nullptr) {
+            return par;
+        }
+        observer.OnVisit(v);
+        if (v->is_end || k < key_of(v)) {
+            return LowerBound(v->left_son, v, k, key_of, observer);
+        } else if (key_of(v) < k) {
+            return LowerBound(v->right_son, par, k, key_of, observer);
+        }
+        return v;
+    }
+    // Next two methods return the in-order neighbours of a vertex, they implement increments and decrements of
+    // the iterators. The next vertex of the end vertex and the previous vertex of the minimal vertex is the vertex
+    // itself. The transition may take up to O(log n) operations, but passage through the entire tree takes O(n).
+    template<class HookPtr>
+    static HookPtr Next(HookPtr v) {
+        if (v->is_end) {
+            return v;
+        }
+        if (v->right_son != nullptr) {
+            return FindMin(HookPtr(v->right_son));
+        }
+        while (v->parent->right_son == v) {
+            v = v->parent;
+        }
+        return v->parent;
+    }
+    template<class HookPtr>
+    static HookPtr Prev(HookPtr v) {
+        if (v->left_son != nullptr) {
+            return FindEnd(HookPtr(v->left_son));
+        }
+        HookPtr u = v;
+        while (u->parent != nullptr && u->parent->left_son == u) {
+            u = u->parent;
+        }
+        if (u->parent == nullptr) {
+            return v;
+        }
+        return u->parent;
+    }
+    // Next methods do the same for trees without parent links, keeping the path from the root instead.
+    // Fills the path to the minimal vertex of the tree.
+    static void PathToMin(const Hook* root, AvlPath<Hook>& path) {
+        path.depth = 0;
+        for (const Hook* v = root; v != nullptr; v = v->left_son) {
+            path.Push(v);
+        }
+    }
+    // Fills the path to the end vertex of the tree.
+    static void PathToEnd(const Hook* root, AvlPath<Hook>& path) {
+        path.depth = 0;
+        for (const Hook* v = root; v != nullptr; v = v->right_son) {
+            path.Push(v);
+        }
+    }
+    // Fills the path to the vertex with the given key value, or to the end vertex if such vertex does not exist.
+    template<class K, class KeyOf, class Observer = AvlNullObserver>
+    static void FindPath(const Hook* root, const K& k, KeyOf key_of, AvlPath<Hook>& path,
+                         Observer observer = Observer()) {
+        path.depth = 0;
+        for (const Hook* v = root; v != nullptr;) {
+            observer.OnVisit(v);
+            path.Push(v);
+            if (v->is_end || k < key_of(v)) {
+                v = v->left_son;
+            } else if (key_of(v) < k) {
+                v = v->right_son;
+            } else {
+                return;
+            }
+        }
+        PathToEnd(root, path);
+    }
+    // Fills the path to the vertex with the minimal value more or equal to the given key value.
+    template<class K, class KeyOf, class Observer = AvlNullObserver>
+    static void LowerBoundPath(const Hook* root, const K& k, KeyOf key_of, AvlPath<Hook>& path,
+                               Observer observer = Observer()) {
+        path.depth = 0;
+        size_t bound = 0;
+        for (const Hook* v = root; v != nullptr;) {
+            observer.OnVisit(v);
+            path.Push(v);
+            if (v->is_end || k < key_of(v)) {
+                bound = path.depth;
+                v = v->left_son;
+            } else if (key_of(v) < k) {
+                v = v->right_son;
+            } else {
+                return;
+            }
+        }
+        path.depth = bound;
+    }
+    static void Next(AvlPath<Hook>& path) {
+        const Hook* v = path.Top();
+        if (v->is_end) {
+            return;
+        }
+        if (v->right_son != nullptr) {
+            for (v = v->right_son; v != nullptr; v = v->left_son) {
+                path.Push(v);
+            }
+            return;
+        }
+        do {
+            v = path.Top();
+            --path.depth;
+        } while (path.Top()->right_son == v);
+    }
+    static void Prev(AvlPath<Hook>& path) {
+        const Hook* v = path.Top();
+        if (v->left_son != nullptr) {
+            for (v = v->left_son; v != nullptr; v = v->right_son) {
+                path.Push(v);
+            }
+            return;
+        }
+        size_t depth = path.depth;
+        do {
+            v = path.Top();
+            --path.depth;
+        } while (path.depth > 0 && path.Top()->left_son == v);
+        if (path.depth == 0) {
+            path.depth = depth;
+        }
+    }
+private:
+    // Puts the vertex n in place of the son v of the given parent, returns the new root of the tree.
+    static Hook* ReplaceSon(Hook* root, Hook* parent, Hook* v, Hook* n) {
+        if (n != nullptr) {
+            n->parent = parent;
+        }
+        if (parent == nullptr) {
+            return n;
+        }
+        if (parent->left_son == v) {
+            parent->left_son = n;
+        } else {
+            parent->right_son = n;
+        }
+        return root;
+    }
+};
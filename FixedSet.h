@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+
+// Immutable set of N keys, which can be built at compile time. The keys are kept in a sorted array and searched
+// with a branchless binary search (https://arxiv.org/abs/1509.05053), so a constexpr FixedSet lives in .rodata and
+// needs no construction at run time. Supports the lookup methods of Set.
+//
+// Usage:
+//     constexpr FixedSet kOpcodes{{0x90, 0x0f, 0xc3}};
+//     static_assert(kOpcodes.find(0xc3) != kOpcodes.end());
+
+template<class T, size_t N>
+class FixedSet {
+public:
+    using iterator = const T*;
+
+    // Builds the set from N distinct keys, given in any order. Duplicate keys make the constant evaluation fail
+    // and throw std::invalid_argument at run time. Complexity O(N^2), normally paid by the compiler.
+    constexpr FixedSet(const T (&keys)[N]) : keys_() {
+        for (size_t i = 0; i < N; ++i) {
+            size_t j = i;
+            while (j > 0 && keys[i] < keys_[j - 1]) {
+                keys_[j] = keys_[j - 1];
+                --j;
+            }
+            keys_[j] = keys[i];
+        }
+        for (size_t i = 1; i < N; ++i) {
+            if (!(keys_[i - 1] < keys_[i])) {
+                throw std::invalid_argument("FixedSet: duplicate keys");
+            }
+        }
+    }
+    // Returns the number of elements in the set.
+    constexpr size_t size() const {
+        return N;
+    }
+    // Returns true if the set is empty.
+    constexpr bool empty() const {
+        return N == 0;
+    }
+    // Returns an iterator to the element with the given key or past-the-end iterator if no such element is found.
+    // Complexity O(log n).
+    constexpr iterator find(const T& k) const {
+        iterator it = lower_bound(k);
+        if (it == end() || k < *it) {
+            return end();
+        }
+        return it;
+    }
+    // Returns iterator to the first element with the value more or equal to the given key. Complexity O(log n).
+    // The loop has a fixed trip count for the given N and its body compiles to a conditional move.
+    constexpr iterator lower_bound(const T& k) const {
+        if (N == 0) {
+            return end();
+        }
+        iterator base = keys_.data();
+        size_t n = N;
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half] < k ? base + half : base;
+            n -= half;
+        }
+        return base + (*base < k);
+    }
+    // Returns iterator to the first element.
+    constexpr iterator begin() const {
+        return keys_.data();
+    }
+    // Return past-the-end iterator.
+    constexpr iterator end() const {
+        return keys_.data() + N;
+    }
+private:
+    std::array<T, N> keys_;
+};
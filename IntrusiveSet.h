@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#include "AvlTree.h"
+
+// Intrusive set of objects ordered by operator<, based on AVL-tree.
+// The set does not own, allocate or copy its elements: it links the AvlHook member of the object selected by Member,
+// or the AvlHook base class of the object without Member. An object can be in several sets at once, one AvlHook member
+// per set. Member hooks need a standard-layout T, so that the object is found from its hook by a fixed offset; other
+// types derive from AvlHook. Objects must stay alive and keep their order while they are linked; erasing an object or
+// destroying the set resets its hook.
+//
+// Usage:
+//     struct Order {
+//         int64_t price;
+//         AvlHook by_price;
+//         bool operator<(const Order& o) const { return price < o.price; }
+//     };
+//     IntrusiveSet<Order, &Order::by_price> book;
+//
+//     class Session : public AvlHook { ... virtual ~Session(); };
+//     IntrusiveSet<Session> sessions;
+
+template<class T, AvlHook T::*Member = nullptr>
+class IntrusiveSet {
+private:
+    using Tree = AvlTree<AvlHook>;
+    static_assert(Member != nullptr || std::is_base_of<AvlHook, T>::value,
+                  "IntrusiveSet without Member needs T derived from AvlHook");
+    static_assert(Member == nullptr || std::is_standard_layout<T>::value,
+                  "IntrusiveSet with a member hook needs a standard-layout T, derive T from AvlHook instead");
+public:
+    // Iterator class for the set, using pointer to the hook of the current object to operate.
+    // Supports the similar methods as the STL set iterator.
+    class iterator {
+    public:
+        iterator() = default;
+        explicit iterator(AvlHook* v) : it_(v) {}
+        bool operator==(const iterator& iter) const {
+            return it_ == iter.it_;
+        }
+        bool operator!=(const iterator& iter) const {
+            return it_ != iter.it_;
+        }
+        // Incrementing past-the-last element iterator or decrementing first element iterator causes undefined behaviour.
+        iterator& operator++() {
+            it_ = Tree::Next(it_);
+            return *this;
+        }
+        iterator& operator--() {
+            it_ = Tree::Prev(it_);
+            return *this;
+        }
+        T& operator*() const {
+            return ObjectOf(it_);
+        }
+        T* operator->() const {
+            return &ObjectOf(it_);
+        }
+    private:
+        AvlHook* it_ = nullptr;
+    };
+    // Default set constructor, does not allocate.
+    IntrusiveSet() {
+        end_.is_end = true;
+        root_ = &end_;
+    }
+    // The tree links point into the set object, so it can be neither copied nor moved.
+    IntrusiveSet(const IntrusiveSet&) = delete;
+    IntrusiveSet& operator=(const IntrusiveSet&) = delete;
+    ~IntrusiveSet() {
+        clear();
+    }
+    // Links the object into the set. Returns false and does nothing, if an equal object is already in the set.
+    // Complexity O(log n).
+    bool insert(T& obj) {
+        if (Tree::Find(root_, obj, KeyOfHook()) != nullptr) {
+            return false;
+        }
+        ++size_;
+        root_ = Tree::Insert(root_, HookOf(obj), nullptr, obj, KeyOfHook());
+        return true;
+    }
+    // Unlinks the object, which must be in the set. No search is made: the object is unlinked through its hook and
+    // only the path to the root is rebalanced. Complexity O(log n) in the worst case, O(1) rotations on average.
+    void erase(T& obj) {
+        AvlHook* v = HookOf(obj);
+        --size_;
+        root_ = Tree::Unlink(root_, v);
+        *v = AvlHook();
+    }
+    // Unlinks all the objects and resets their hooks. Complexity O(n).
+    void clear() {
+        ResetHooks(root_);
+        end_ = AvlHook();
+        end_.is_end = true;
+        root_ = &end_;
+        size_ = 0;
+    }
+    // Returns the number of elements in the set.
+    size_t size() const {
+        return size_;
+    }
+    // Returns true if the set is empty.
+    bool empty() const {
+        return size_ == 0;
+    }
+    // Returns an iterator to the object equal to the given one or past-the-end iterator if no such object is found.
+    // Complexity O(log n).
+    iterator find(const T& k) const {
+        AvlHook* v = Tree::Find(root_, k, KeyOfHook());
+        if (v == nullptr) {
+            return end();
+        }
+        return iterator(v);
+    }
+    // Returns iterator to the first object, which is not less than the given one. Complexity O(log n).
+    iterator lower_bound(const T& k) const {
+        return iterator(Tree::LowerBound(root_, nullptr, k, KeyOfHook()));
+    }
+    // Returns an iterator to the given object, which must be in the set. Complexity O(1).
+    static iterator iterator_to(T& obj) {
+        return iterator(HookOf(obj));
+    }
+    // Returns iterator to the first element.
+    iterator begin() const {
+        return iterator(Tree::FindMin(root_));
+    }
+    // Return past-the-end iterator.
+    iterator end() const {
+        return iterator(const_cast<AvlHook*>(&end_));
+    }
+private:
+    // Offset of the member hook inside a standard-layout object, as offsetof would give it for the member name. The
+    // object is an inactive member of a local union, so it is neither constructed nor accessed, only the address of
+    // its hook is taken; the compiler folds the computation into a constant.
+    static ptrdiff_t HookOffset() {
+        union Probe {
+            char bytes[sizeof(T)];
+            T obj;
+            Probe() {}
+            ~Probe() {}
+        } probe;
+        return reinterpret_cast<const char*>(&(probe.obj.*Member)) - probe.bytes;
+    }
+    static AvlHook* HookOf(T& obj) {
+        if constexpr (Member == nullptr) {
+            return static_cast<AvlHook*>(&obj);
+        } else {
+            return &(obj.*Member);
+        }
+    }
+    static T& ObjectOf(const AvlHook* v) {
+        AvlHook* hook = const_cast<AvlHook*>(v);
+        if constexpr (Member == nullptr) {
+            return *static_cast<T*>(hook);
+        } else {
+            return *reinterpret_cast<T*>(reinterpret_cast<char*>(hook) - HookOffset());
+        }
+    }
+    // Maps a tree vertex, which is not the end vertex, to its object.
+    struct KeyOfHook {
+        const T& operator()(const AvlHook* v) const {
+            return ObjectOf(v);
+        }
+    };
+    // Resets the hooks of all the objects in the subtree.
+    void ResetHooks(AvlHook* v) {
+        if (v == nullptr) {
+            return;
+        }
+        ResetHooks(v->left_son);
+        ResetHooks(v->right_son);
+        if (!v->is_end) {
+            *v = AvlHook();
+        }
+    }
+private:
+    AvlHook end_;
+    AvlHook* root_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if !__has_include(<sys/mman.h>)
+#error "MappedSet.h needs POSIX mmap"
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SetTemplate.h"
+
+// Read-only sets of trivially copyable keys, stored in files which are used in place.
+//
+// Format: a 64-byte header (magic "SETMAP", format version, byte order mark, layout, key size and alignment, key
+// count, offset of the keys, checksum of the keys), then the keys in the Eytzinger layout: slot 0 is unused, slot 1
+// holds the root of a complete binary search tree and slot k has the sons 2k and 2k + 1. The tree is implicit in the
+// indices, so the file has no pointers and is valid at any address. The keys start at a multiple of 64 bytes.
+//
+// MappedSet maps the file and serves find, lower_bound and iteration right from the mapping: opening costs a few
+// system calls whatever the size, the pages are read on first use, and processes mapping the same file share its
+// pages in the page cache. The top levels of the tree, which every search goes through, are packed into the first
+// cache lines and pages; a search prefetches the cache line of its great-great-grandsons while it compares.
+// MappedSet::write builds a file from a Set or from a range of keys; it writes a temporary file, syncs it and renames
+// it over the target, then syncs the directory, so the sets mapping the old file keep reading it and after a crash
+// the path holds either the old or the new file.
+
+struct MappedSetHeader {
+    static constexpr char kMagic[8] = {'S', 'E', 'T', 'M', 'A', 'P', '\0', '\0'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint16_t kByteOrderMark = 0x0102;
+    static constexpr uint16_t kEytzinger = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint16_t byte_order;
+    uint16_t layout;
+    uint32_t key_size;
+    uint32_t key_alignment;
+    uint64_t count;
+    uint64_t keys_offset;
+    uint64_t checksum;
+    char reserved[16] = {};
+};
+static_assert(sizeof(MappedSetHeader) == 64, "the mapped set header must have no padding");
+
+template<class T>
+class MappedSet {
+    static_assert(std::is_trivially_copyable<T>::value, "MappedSet needs trivially copyable keys");
+public:
+    // Iterator class of the mapped set, keeping the slot of the current key; the slot 0 is the end.
+    // Supports the same methods as the Set iterators, each step takes up to O(log n) operations.
+    class iterator {
+    public:
+        iterator() = default;
+        bool operator==(const iterator& iter) const {
+            return k_ == iter.k_;
+        }
+        bool operator!=(const iterator& iter) const {
+            return k_ != iter.k_;
+        }
+        // Incrementing past-the-last element iterator or decrementing first element iterator causes undefined
+        // behaviour.
+        iterator& operator++() {
+            k_ = Next(k_, n_);
+            return *this;
+        }
+        iterator& operator--() {
+            k_ = Prev(k_, n_);
+            return *this;
+        }
+        iterator& operator++(int) {
+            return ++*this;
+        }
+        iterator& operator--(int) {
+            return --*this;
+        }
+        T operator*() const {
+            return keys_[k_];
+        }
+        const T* operator->() const {
+            return &keys_[k_];
+        }
+    private:
+        friend class MappedSet;
+        iterator(const T* keys, size_t n, size_t k) : keys_(keys), n_(n), k_(k) {}
+
+        const T* keys_ = nullptr;
+        size_t n_ = 0;
+        size_t k_ = 0;
+    };
+
+    MappedSet() = default;
+    // Maps the file. Throws std::runtime_error if it can not be mapped or is not a mapped set of keys of type T;
+    // the keys themselves are not read, verify() checks them.
+    explicit MappedSet(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("can not open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(MappedSetHeader))) {
+            ::close(fd);
+            throw std::runtime_error(path + " is not a mapped set");
+        }
+        mapping_size_ = static_cast<size_t>(st.st_size);
+        void* mapping = ::mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("can not map " + path + ": " + std::strerror(errno));
+        }
+        mapping_ = mapping;
+        const auto* header = static_cast<const MappedSetHeader*>(mapping_);
+        const char* error = CheckHeader(*header, mapping_size_);
+        if (error != nullptr) {
+            Unmap();
+            throw std::runtime_error(path + ": " + error);
+        }
+        keys_ = reinterpret_cast<const T*>(static_cast<const char*>(mapping_) + header->keys_offset);
+        size_ = static_cast<size_t>(header->count);
+    }
+    MappedSet(const MappedSet&) = delete;
+    MappedSet& operator=(const MappedSet&) = delete;
+    MappedSet(MappedSet&& st) noexcept {
+        Swap(st);
+    }
+    MappedSet& operator=(MappedSet&& st) noexcept {
+        if (this != &st) {
+            Unmap();
+            Swap(st);
+        }
+        return *this;
+    }
+    // Unmaps the file, the iterators become invalid.
+    ~MappedSet() {
+        Unmap();
+    }
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    // Returns the iterator to the key k, or end() if there is none. Complexity O(log n).
+    iterator find(const T& k) const {
+        size_t v = LowerBoundSlot(k);
+        if (v != 0 && !(k < keys_[v])) {
+            return iterator(keys_, size_, v);
+        }
+        return end();
+    }
+    // Returns the iterator to the least key not less than k, or end() if there is none. Complexity O(log n).
+    iterator lower_bound(const T& k) const {
+        return iterator(keys_, size_, LowerBoundSlot(k));
+    }
+    iterator begin() const {
+        return iterator(keys_, size_, First(size_));
+    }
+    iterator end() const {
+        return iterator(keys_, size_, 0);
+    }
+    // Reads all the keys and compares their checksum with the one written with them.
+    bool verify() const {
+        if (mapping_ == nullptr) {
+            return true;
+        }
+        SnapshotChecksum checksum;
+        checksum.Update(reinterpret_cast<const char*>(keys_), (size_ + 1) * sizeof(T));
+        return checksum.Digest() == static_cast<const MappedSetHeader*>(mapping_)->checksum;
+    }
+    // Writes the keys of the set to a mapped set file. Throws std::runtime_error if the file can not be written.
+    template<class Allocator, class Options>
+    static void write(const std::string& path, const Set<T, Allocator, Options>& set) {
+        write(path, set.begin(), set.end());
+    }
+    // Writes the keys of the range, which must be increasing, to a mapped set file. Throws std::invalid_argument if
+    // they are not increasing and std::runtime_error if the file can not be written.
+    template<class Iterator>
+    static void write(const std::string& path, Iterator first, Iterator last) {
+        std::vector<T> sorted;
+        for (; first != last; ++first) {
+            sorted.push_back(*first);
+            if (sorted.size() > 1 && !(sorted[sorted.size() - 2] < sorted.back())) {
+                throw std::invalid_argument("the keys of a mapped set must be increasing");
+            }
+        }
+        size_t n = sorted.size();
+        // An in-order walk of the implicit tree visits the slots in the order of the keys. Slot 0 is never read,
+        // it is written as zeros, keys[v - 1] is the slot v.
+        std::vector<char> slot0(sizeof(T), 0);
+        std::vector<T> keys(sorted);
+        size_t v = First(n);
+        for (const T& k : sorted) {
+            keys[v - 1] = k;
+            v = Next(v, n);
+        }
+
+        MappedSetHeader header;
+        std::memcpy(header.magic, MappedSetHeader::kMagic, sizeof(header.magic));
+        header.version = MappedSetHeader::kVersion;
+        header.byte_order = MappedSetHeader::kByteOrderMark;
+        header.layout = MappedSetHeader::kEytzinger;
+        header.key_size = sizeof(T);
+        header.key_alignment = alignof(T);
+        header.count = n;
+        header.keys_offset = KeysOffset();
+        SnapshotChecksum checksum;
+        checksum.Update(slot0.data(), slot0.size());
+        if (n != 0) {
+            checksum.Update(reinterpret_cast<const char*>(keys.data()), n * sizeof(T));
+        }
+        header.checksum = checksum.Digest();
+
+        std::string temporary = path + ".tmp";
+        std::FILE* f = std::fopen(temporary.c_str(), "wb");
+        if (f == nullptr) {
+            throw std::runtime_error("can not open " + temporary);
+        }
+        std::vector<char> padding(KeysOffset() - sizeof(header), 0);
+        bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && (padding.empty() || std::fwrite(padding.data(), 1, padding.size(), f) == padding.size());
+        ok = ok && std::fwrite(slot0.data(), 1, slot0.size(), f) == slot0.size();
+        ok = ok && (n == 0 || std::fwrite(keys.data(), sizeof(T), n, f) == n);
+        ok = ok && std::fflush(f) == 0 && ::fsync(::fileno(f)) == 0;
+        ok = std::fclose(f) == 0 && ok;
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("can not write " + path);
+        }
+        SyncDirectoryOf(path);
+    }
+private:
+    // Makes a rename into the directory of the path durable.
+    static void SyncDirectoryOf(const std::string& path) {
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        bool ok = fd >= 0 && ::fsync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!ok) {
+            throw std::runtime_error("can not sync the directory of " + path);
+        }
+    }
+    // Keys per cache line; a search prefetches the line of the slot 16k, which holds the 16 great-great-grandsons
+    // of the slot k when 16 keys fit in a line.
+    static constexpr size_t kPrefetchStride = 64 / sizeof(T) == 0 ? 1 : 64 / sizeof(T);
+
+    // The keys follow the header, at a cache line boundary, or at the alignment of T if it is larger.
+    static constexpr uint64_t KeysOffset() {
+        return alignof(T) > sizeof(MappedSetHeader) ? alignof(T) : sizeof(MappedSetHeader);
+    }
+    static const char* CheckHeader(const MappedSetHeader& header, size_t file_size) {
+        if (std::memcmp(header.magic, MappedSetHeader::kMagic, sizeof(header.magic)) != 0) {
+            return "not a mapped set";
+        }
+        if (header.version != MappedSetHeader::kVersion || header.layout != MappedSetHeader::kEytzinger) {
+            return "unsupported mapped set version";
+        }
+        if (header.byte_order != MappedSetHeader::kByteOrderMark) {
+            return "mapped set of a different byte order";
+        }
+        if (header.key_size != sizeof(T) || header.key_alignment != alignof(T)) {
+            return "mapped set of a different key type";
+        }
+        // The file holds exactly the slots 0 to count.
+        if (header.keys_offset != KeysOffset() || file_size < KeysOffset() + sizeof(T) ||
+            (file_size - KeysOffset()) % sizeof(T) != 0 || (file_size - KeysOffset()) / sizeof(T) - 1 != header.count) {
+            return "truncated mapped set";
+        }
+        return nullptr;
+    }
+    static size_t TrailingZeros(size_t x) {
+#if defined(__GNUC__)
+        return static_cast<size_t>(__builtin_ctzll(x));
+#else
+        size_t r = 0;
+        for (; (x & 1) == 0; x >>= 1) {
+            ++r;
+        }
+        return r;
+#endif
+    }
+    // Slot of the least key, 0 in an empty set.
+    static size_t First(size_t n) {
+        if (n == 0) {
+            return 0;
+        }
+        size_t v = 1;
+        while (2 * v <= n) {
+            v = 2 * v;
+        }
+        return v;
+    }
+    // In-order successor of the slot v, 0 after the greatest key: the leftmost slot of the right subtree if there
+    // is one, otherwise the parent of the last left son on the way up.
+    static size_t Next(size_t v, size_t n) {
+        if (2 * v + 1 <= n) {
+            v = 2 * v + 1;
+            while (2 * v <= n) {
+                v = 2 * v;
+            }
+            return v;
+        }
+        return v >> (TrailingZeros(~v) + 1);
+    }
+    // In-order predecessor of the slot v, the greatest key for v = 0.
+    static size_t Prev(size_t v, size_t n) {
+        if (v == 0) {
+            v = 1;
+            while (2 * v + 1 <= n) {
+                v = 2 * v + 1;
+            }
+            return v;
+        }
+        if (2 * v <= n) {
+            v = 2 * v;
+            while (2 * v + 1 <= n) {
+                v = 2 * v + 1;
+            }
+            return v;
+        }
+        return v >> (TrailingZeros(v) + 1);
+    }
+    // The descent goes right past the keys less than k, without branching on the comparison; then the slot of the
+    // lower bound is the parent of the last left son taken, found by dropping the trailing right turns.
+    size_t LowerBoundSlot(const T& k) const {
+        size_t v = 1;
+        while (v <= size_) {
+#if defined(__GNUC__)
+            __builtin_prefetch(keys_ + kPrefetchStride * v);
+#endif
+            v = 2 * v + static_cast<size_t>(keys_[v] < k);
+        }
+        return v >> (TrailingZeros(~v) + 1);
+    }
+    void Unmap() {
+        if (mapping_ != nullptr) {
+            ::munmap(mapping_, mapping_size_);
+            mapping_ = nullptr;
+        }
+    }
+    void Swap(MappedSet& st) {
+        std::swap(mapping_, st.mapping_);
+        std::swap(mapping_size_, st.mapping_size_);
+        std::swap(keys_, st.keys_);
+        std::swap(size_, st.size_);
+    }
+
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    const T* keys_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+// Node allocator with per-thread magazines and a global depot, https://www.usenix.org/legacy/event/usenix01/bonwick.html
+// Single-object allocations are served from a thread-local free list (magazine) without any locking. When the magazine
+// overflows, a chain of kMagazineSize blocks is handed to the global depot; when it runs dry, a chain is taken back from
+// the depot or a new slab is carved. So the depot mutex is taken at most once per kMagazineSize operations.
+// A block freed by a thread other than the one that allocated it simply goes to the magazine of the freeing thread,
+// blocks of one size class are interchangeable, so cross-thread frees need no special handling.
+// Slabs are returned to the operating system only by ShrinkToFit. Allocations of more than one object go to
+// std::allocator.
+// The caches are per size class: NodeAllocator<T> and NodeAllocator<U> share one when T and U have the same size and
+// alignment, and reserve and shrink_to_fit act on the size class of the allocator they are called on.
+
+namespace node_allocator_detail {
+
+// Free blocks are linked through their own memory. The first block of a chain in the depot also keeps the link to
+// the next chain and the length of its own chain.
+struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* next_chain;
+    size_t chain_size;
+};
+
+constexpr size_t RoundUp(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+// Cache of free blocks of one size class. All the state is static, so every allocator instance shares it.
+template<size_t Size, size_t Align>
+class NodeCache {
+public:
+    static constexpr size_t kBlockSize = RoundUp(Size < sizeof(FreeBlock) ? sizeof(FreeBlock) : Size,
+                                                 Align < alignof(FreeBlock) ? alignof(FreeBlock) : Align);
+    static constexpr size_t kMagazineSize = 64;
+    static constexpr size_t kSlabBytes = 64 * 1024;
+    static_assert(kBlockSize * 4 <= kSlabBytes, "NodeCache is meant for small objects");
+
+    // Returns a block of kBlockSize bytes. Complexity O(1) amortized.
+    static void* Allocate() {
+        Magazine& m = LocalMagazine();
+        if (m.head != nullptr) {
+            FreeBlock* b = m.head;
+            m.head = b->next;
+            --m.count;
+            return b;
+        }
+        if (m.bump != m.bump_end) {
+            void* b = m.bump;
+            m.bump += kBlockSize;
+            return b;
+        }
+        if (m.dead) {
+            return AllocateFromDepot();
+        }
+        return Refill(m);
+    }
+    // Returns a block to the cache of the calling thread. Complexity O(1) amortized.
+    static void Deallocate(void* p) noexcept {
+        Magazine& m = LocalMagazine();
+        FreeBlock* b = static_cast<FreeBlock*>(p);
+        if (m.dead) {
+            b->next = nullptr;
+            PushChain(b, 1);
+            return;
+        }
+        b->next = m.head;
+        m.head = b;
+        ++m.count;
+        if (m.count > m.limit) {
+            Spill(m);
+        }
+    }
+    // Makes sure that the calling thread can allocate at least n blocks without taking the depot lock or calling
+    // the global allocator. Missing capacity is allocated as whole slabs. The magazine of the thread then keeps up to
+    // that many free blocks, instead of spilling to the depot above 2 * kMagazineSize, until ShrinkToFit is called
+    // from the thread or the thread exits.
+    static void Reserve(size_t n) {
+        Magazine& m = LocalMagazine();
+        size_t available = m.count + (m.bump_end - m.bump) / kBlockSize;
+        while (available < n) {
+            char* slab = NewSlab();
+            FreeBlock* chain = LinkRange(slab, slab + kBlocksPerSlab * kBlockSize);
+            reinterpret_cast<FreeBlock*>(slab + (kBlocksPerSlab - 1) * kBlockSize)->next = m.head;
+            m.head = chain;
+            m.count += kBlocksPerSlab;
+            available += kBlocksPerSlab;
+        }
+        if (m.count > m.limit) {
+            m.limit = m.count;
+        }
+    }
+    // Moves the free blocks of the calling thread to the depot and returns to the operating system all the slabs,
+    // whose blocks are all free in the depot. Blocks cached by other threads keep their slabs alive.
+    // Returns the number of bytes released. Complexity O(number of free blocks in the depot).
+    static size_t ShrinkToFit() {
+        Magazine& m = LocalMagazine();
+        if (!m.dead) {
+            FlushMagazine(m);
+        }
+        Depot& depot = GetDepot();
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        std::unordered_map<char*, size_t> free_blocks;
+        for (FreeBlock* chain = depot.chains; chain != nullptr; chain = chain->next_chain) {
+            for (FreeBlock* b = chain; b != nullptr; b = b->next) {
+                ++free_blocks[SlabOf(b)];
+            }
+        }
+        FreeBlock* chains = nullptr;
+        FreeBlock* chain = nullptr;
+        size_t chain_size = 0;
+        for (FreeBlock* next_chain = depot.chains; next_chain != nullptr;) {
+            FreeBlock* b = next_chain;
+            next_chain = next_chain->next_chain;
+            while (b != nullptr) {
+                FreeBlock* next = b->next;
+                if (free_blocks[SlabOf(b)] != kBlocksPerSlab) {
+                    b->next = chain;
+                    chain = b;
+                    if (++chain_size == kMagazineSize) {
+                        chain->chain_size = chain_size;
+                        chain->next_chain = chains;
+                        chains = chain;
+                        chain = nullptr;
+                        chain_size = 0;
+                    }
+                }
+                b = next;
+            }
+        }
+        if (chain != nullptr) {
+            chain->chain_size = chain_size;
+            chain->next_chain = chains;
+            chains = chain;
+        }
+        depot.chains = chains;
+        size_t released = 0;
+        for (const auto& slab : free_blocks) {
+            if (slab.second == kBlocksPerSlab) {
+                ::operator delete(slab.first, std::align_val_t(kSlabBytes));
+                released += kSlabBytes;
+            }
+        }
+        return released;
+    }
+private:
+    static constexpr size_t kBlocksPerSlab = kSlabBytes / kBlockSize;
+
+    // The thread-local part is trivially destructible, so it stays usable after the thread exit guard has run
+    // (for instance, by sets with static storage duration, destroyed after the thread-locals of the main thread).
+    struct Magazine {
+        FreeBlock* head;
+        size_t count;
+        size_t limit;  // Deallocate spills blocks to the depot above this count.
+        char* bump;
+        char* bump_end;
+        bool dead;
+    };
+    // Returns all the blocks of the thread to the depot when the thread exits.
+    struct ThreadGuard {
+        ~ThreadGuard() {
+            Magazine& m = LocalMagazine();
+            FlushMagazine(m);
+            m.dead = true;
+        }
+    };
+    struct Depot {
+        std::mutex mutex;
+        FreeBlock* chains = nullptr;
+    };
+
+    static Magazine& LocalMagazine() {
+        static thread_local Magazine magazine{nullptr, 0, 2 * kMagazineSize, nullptr, nullptr, false};
+        static thread_local ThreadGuard guard;
+        (void)guard;
+        return magazine;
+    }
+    // The depot is never destroyed, so it outlives every thread and every static object.
+    static Depot& GetDepot() {
+        static Depot* depot = new Depot();
+        return *depot;
+    }
+    // Moves all the free blocks of the magazine to the depot.
+    static void FlushMagazine(Magazine& m) {
+        if (m.head != nullptr) {
+            PushChain(m.head, m.count);
+        }
+        if (m.bump != m.bump_end) {
+            PushChain(LinkRange(m.bump, m.bump_end), (m.bump_end - m.bump) / kBlockSize);
+        }
+        m.head = nullptr;
+        m.count = 0;
+        m.limit = 2 * kMagazineSize;
+        m.bump = nullptr;
+        m.bump_end = nullptr;
+    }
+    // Slabs are aligned to their size, so the slab of a block is found by masking the block address.
+    static char* SlabOf(FreeBlock* b) {
+        return reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(b) & ~(uintptr_t(kSlabBytes) - 1));
+    }
+    static char* NewSlab() {
+        return static_cast<char*>(::operator new(kSlabBytes, std::align_val_t(kSlabBytes)));
+    }
+    // Links blocks of the memory range [begin, end) into a chain.
+    static FreeBlock* LinkRange(char* begin, char* end) {
+        FreeBlock* head = nullptr;
+        while (end != begin) {
+            end -= kBlockSize;
+            FreeBlock* b = reinterpret_cast<FreeBlock*>(end);
+            b->next = head;
+            head = b;
+        }
+        return head;
+    }
+    static void PushChain(FreeBlock* chain, size_t chain_size) {
+        Depot& depot = GetDepot();
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        chain->chain_size = chain_size;
+        chain->next_chain = depot.chains;
+        depot.chains = chain;
+    }
+    // Moves kMagazineSize blocks from the magazine to the depot.
+    static void Spill(Magazine& m) {
+        FreeBlock* chain = m.head;
+        FreeBlock* last = chain;
+        for (size_t i = 1; i < kMagazineSize; ++i) {
+            last = last->next;
+        }
+        m.head = last->next;
+        m.count -= kMagazineSize;
+        last->next = nullptr;
+        PushChain(chain, kMagazineSize);
+    }
+    // Takes a chain from the depot or carves a new slab when the magazine is empty.
+    static void* Refill(Magazine& m) {
+        Depot& depot = GetDepot();
+        {
+            std::lock_guard<std::mutex> lock(depot.mutex);
+            if (depot.chains != nullptr) {
+                FreeBlock* chain = depot.chains;
+                depot.chains = chain->next_chain;
+                m.head = chain->next;
+                m.count = chain->chain_size - 1;
+                return chain;
+            }
+        }
+        char* slab = NewSlab();
+        m.bump = slab + kBlockSize;
+        m.bump_end = slab + kBlocksPerSlab * kBlockSize;
+        return slab;
+    }
+    // Slow path for threads which have already run their exit guard.
+    static void* AllocateFromDepot() {
+        Depot& depot = GetDepot();
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        if (depot.chains == nullptr) {
+            char* slab = NewSlab();
+            depot.chains = LinkRange(slab, slab + kBlocksPerSlab * kBlockSize);
+            depot.chains->next_chain = nullptr;
+            depot.chains->chain_size = kBlocksPerSlab;
+        }
+        FreeBlock* b = depot.chains;
+        depot.chains = b->next_chain;
+        if (b->next != nullptr) {
+            b->next->next_chain = depot.chains;
+            b->next->chain_size = b->chain_size - 1;
+            depot.chains = b->next;
+        }
+        return b;
+    }
+};
+
+}  // namespace node_allocator_detail
+
+// Standard allocator interface to the node caches. Stateless, all the instances compare equal.
+template<class T>
+class NodeAllocator {
+public:
+    using value_type = T;
+
+    NodeAllocator() noexcept = default;
+    template<class U>
+    NodeAllocator(const NodeAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n == 1) {
+            return static_cast<T*>(Cache::Allocate());
+        }
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        if (n == 1) {
+            Cache::Deallocate(p);
+            return;
+        }
+        std::allocator<T>().deallocate(p, n);
+    }
+    // Lets the calling thread allocate n single objects of type T without calling the global allocator or taking the
+    // depot lock. The reservation belongs to the thread and to the size class of T: other threads do not see it, and
+    // a container allocating rebound nodes must reserve through an allocator rebound to its node type, as
+    // Set::reserve does. Freed objects stay with the thread up to the reserved count.
+    void reserve(size_t n) {
+        Cache::Reserve(n);
+    }
+    // Returns fully free slabs of the single-object cache of the size class of T to the operating system, after moving
+    // the free blocks of the calling thread to the depot and ending its reservation. Returns the number of bytes
+    // released.
+    size_t shrink_to_fit() {
+        return Cache::ShrinkToFit();
+    }
+    template<class U>
+    bool operator==(const NodeAllocator<U>&) const noexcept {
+        return true;
+    }
+    template<class U>
+    bool operator!=(const NodeAllocator<U>&) const noexcept {
+        return false;
+    }
+private:
+    using Cache = node_allocator_detail::NodeCache<sizeof(T), alignof(T)>;
+};
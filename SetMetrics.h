@@ -0,0 +1,369 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if __has_include(<unistd.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SetTemplate.h"
+
+// Registry of named sets, which publish their structural statistics (Set::stats()) and, for sets with
+// SetOptions::kCounters, their operation counters. RenderPrometheus renders all of them in the Prometheus text
+// exposition format (https://prometheus.io/docs/instrumenting/exposition_formats/), one series per set labelled
+// with set="<name>". Collecting walks every registered set, which takes O(n) per set.
+// Registering is opt-in and lasts as long as the returned Registration. A set, which is modified by other threads,
+// is registered together with the mutex guarding it, the registry locks it while collecting. The registry lock is not
+// held while collecting, so sets may be registered while their mutexes are held; a Registration must not be destroyed
+// while its mutex is held, since unregistering waits for a collection of the set in progress.
+
+// Metrics of one registered set.
+struct SetMetricsSnapshot {
+    std::string name;
+    SetStats stats;
+    bool has_counters = false;
+    SetCounters counters;
+};
+
+inline std::string RenderPrometheus(const std::vector<SetMetricsSnapshot>& snapshots);
+
+class SetMetricsRegistry {
+public:
+    // Keeps a set registered, unregisters it on destruction.
+    class Registration {
+    public:
+        Registration() = default;
+        Registration(Registration&& other) noexcept
+            : registry_(std::exchange(other.registry_, nullptr)), name_(std::move(other.name_)) {
+        }
+        Registration& operator=(Registration&& other) noexcept {
+            if (this != &other) {
+                Reset();
+                registry_ = std::exchange(other.registry_, nullptr);
+                name_ = std::move(other.name_);
+            }
+            return *this;
+        }
+        ~Registration() {
+            Reset();
+        }
+        // Unregisters the set now.
+        void Reset() {
+            if (registry_ != nullptr) {
+                registry_->Unregister(name_);
+                registry_ = nullptr;
+            }
+        }
+    private:
+        friend class SetMetricsRegistry;
+        Registration(SetMetricsRegistry* registry, std::string name) : registry_(registry), name_(std::move(name)) {
+        }
+
+        SetMetricsRegistry* registry_ = nullptr;
+        std::string name_;
+    };
+
+    // Returns the registry of the process. It is never destroyed, so sets with static storage duration may stay
+    // registered until the exit.
+    static SetMetricsRegistry& Global() {
+        static SetMetricsRegistry* registry = new SetMetricsRegistry();
+        return *registry;
+    }
+    // Registers the set under the given name, throws std::invalid_argument if the name is taken. The set must not be
+    // modified while the metrics are collected.
+    template<class S>
+    Registration Register(std::string name, const S& set) {
+        return Add(std::move(name), [&set]() { return Collect(set); });
+    }
+    // Registers the set, guarded by the given mutex, under the given name.
+    template<class S, class Mutex>
+    Registration Register(std::string name, const S& set, Mutex& mutex) {
+        return Add(std::move(name), [&set, &mutex]() {
+            std::lock_guard<Mutex> lock(mutex);
+            return Collect(set);
+        });
+    }
+    // Collects the metrics of all the registered sets, ordered by name. The entries are copied under the registry
+    // lock and collected after it is released, the sets unregistered meanwhile are left out.
+    std::vector<SetMetricsSnapshot> Snapshot() const {
+        std::vector<std::pair<std::string, std::shared_ptr<Entry>>> entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries.assign(entries_.begin(), entries_.end());
+        }
+        std::vector<SetMetricsSnapshot> snapshots;
+        for (const auto& entry : entries) {
+            std::lock_guard<std::mutex> lock(entry.second->mutex);
+            if (!entry.second->registered) {
+                continue;
+            }
+            snapshots.push_back(entry.second->collect());
+            snapshots.back().name = entry.first;
+        }
+        return snapshots;
+    }
+    // Renders the metrics of all the registered sets in the Prometheus text format.
+    std::string RenderPrometheus() const {
+        return ::RenderPrometheus(Snapshot());
+    }
+    // Writes the metrics to the file, through a temporary file renamed over it, so that readers such as the textfile
+    // collector of node_exporter never see a partial file. On POSIX systems the temporary file is synced before the
+    // rename and the directory after it, so after a crash the file holds either the old or the new metrics. Throws
+    // std::runtime_error if the file can not be written.
+    void WritePrometheus(const std::string& path) const {
+        std::string text = RenderPrometheus();
+        std::string temporary = path + ".tmp";
+        std::FILE* f = std::fopen(temporary.c_str(), "wb");
+        if (f == nullptr) {
+            throw std::runtime_error("can not open " + temporary);
+        }
+        bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+        ok = ok && std::fflush(f) == 0;
+#if __has_include(<unistd.h>)
+        ok = ok && ::fsync(::fileno(f)) == 0;
+#endif
+        ok = std::fclose(f) == 0 && ok;
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("can not write " + path);
+        }
+#if __has_include(<unistd.h>)
+        size_t slash = path.rfind('/');
+        std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        ok = fd >= 0 && ::fsync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!ok) {
+            throw std::runtime_error("can not sync the directory of " + path);
+        }
+#endif
+    }
+private:
+    template<class S>
+    static SetMetricsSnapshot Collect(const S& set) {
+        SetMetricsSnapshot snapshot;
+        snapshot.stats = set.stats();
+        if constexpr (S::options_type::kCounters) {
+            snapshot.has_counters = true;
+            snapshot.counters = set.counters();
+        }
+        return snapshot;
+    }
+    // A registered set. Its mutex is held while the set is collected, so that unregistering waits for the collection
+    // and the set is not used after its Registration is gone.
+    struct Entry {
+        std::function<SetMetricsSnapshot()> collect;
+        std::mutex mutex;
+        bool registered = true;
+    };
+
+    Registration Add(std::string name, std::function<SetMetricsSnapshot()> collect) {
+        auto entry = std::make_shared<Entry>();
+        entry->collect = std::move(collect);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!entries_.emplace(name, std::move(entry)).second) {
+            throw std::invalid_argument("set " + name + " is already registered");
+        }
+        return Registration(this, std::move(name));
+    }
+    void Unregister(const std::string& name) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(name);
+            if (it == entries_.end()) {
+                return;
+            }
+            entry = std::move(it->second);
+            entries_.erase(it);
+        }
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->registered = false;
+    }
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Entry>> entries_;
+};
+
+namespace set_metrics_detail {
+
+// Escapes a label value: backslash, double quote and line feed.
+inline std::string EscapeLabel(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+inline void AppendHeader(std::string& out, const char* metric, const char* type, const char* help) {
+    out += "# HELP ";
+    out += metric;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += metric;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+// Appends a sample line: metric{set="name"[,extra]} value.
+inline void AppendSample(std::string& out, const std::string& metric, const std::string& set, const std::string& extra,
+                         double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.17g", value);
+    out += metric;
+    out += "{set=\"";
+    out += EscapeLabel(set);
+    out += '"';
+    if (!extra.empty()) {
+        out += ',';
+        out += extra;
+    }
+    out += "} ";
+    out += number;
+    out += '\n';
+}
+
+}  // namespace set_metrics_detail
+
+// Renders the metrics in the Prometheus text format. Counter families are present only if some set has counters.
+inline std::string RenderPrometheus(const std::vector<SetMetricsSnapshot>& snapshots) {
+    using set_metrics_detail::AppendHeader;
+    using set_metrics_detail::AppendSample;
+    std::string out;
+    // Gauges taken from the structural statistics.
+    struct Gauge {
+        const char* metric;
+        const char* help;
+        double (*value)(const SetStats&);
+    };
+    static const Gauge kGauges[] = {
+        {"set_size", "Number of elements.", [](const SetStats& s) { return static_cast<double>(s.size); }},
+        {"set_height", "Number of vertices on the longest path from the root.",
+         [](const SetStats& s) { return static_cast<double>(s.height); }},
+        {"set_height_bound", "AVL height bound 1.44 log2(size + 3), the end vertex included.",
+         [](const SetStats& s) { return s.height_bound; }},
+        {"set_mean_depth", "Mean depth of a vertex, the cost of a successful search.",
+         [](const SetStats& s) { return s.mean_depth; }},
+        {"set_mean_external_path_length", "Mean depth of a null link, the cost of an unsuccessful search.",
+         [](const SetStats& s) { return s.mean_external_path_length; }},
+        {"set_unbalanced_vertices", "Vertices violating the AVL balance or with a wrong stored height.",
+         [](const SetStats& s) { return static_cast<double>(s.unbalanced + s.wrong_heights); }},
+        {"set_bytes", "Estimated bytes used by the set and its vertices.",
+         [](const SetStats& s) { return static_cast<double>(s.bytes); }},
+    };
+    for (const Gauge& gauge : kGauges) {
+        AppendHeader(out, gauge.metric, "gauge", gauge.help);
+        for (const SetMetricsSnapshot& s : snapshots) {
+            AppendSample(out, gauge.metric, s.name, "", gauge.value(s.stats));
+        }
+    }
+    AppendHeader(out, "set_vertex_depth", "histogram", "Depths of the key vertices, the root is at depth 0.");
+    for (const SetMetricsSnapshot& s : snapshots) {
+        size_t cumulative = 0;
+        size_t sum = 0;
+        for (size_t depth = 0; depth < s.stats.depth_histogram.size(); ++depth) {
+            cumulative += s.stats.depth_histogram[depth];
+            sum += depth * s.stats.depth_histogram[depth];
+            AppendSample(out, "set_vertex_depth_bucket", s.name, "le=\"" + std::to_string(depth) + "\"",
+                         static_cast<double>(cumulative));
+        }
+        AppendSample(out, "set_vertex_depth_bucket", s.name, "le=\"+Inf\"", static_cast<double>(cumulative));
+        AppendSample(out, "set_vertex_depth_sum", s.name, "", static_cast<double>(sum));
+        AppendSample(out, "set_vertex_depth_count", s.name, "", static_cast<double>(cumulative));
+    }
+
+    bool any_counters = false;
+    for (const SetMetricsSnapshot& s : snapshots) {
+        any_counters = any_counters || s.has_counters;
+    }
+    if (!any_counters) {
+        return out;
+    }
+    struct Operation {
+        const char* name;
+        OperationCounters SetCounters::*counters;
+    };
+    static const Operation kOperations[] = {
+        {"insert", &SetCounters::insert},
+        {"erase", &SetCounters::erase},
+        {"find", &SetCounters::find},
+        {"lower_bound", &SetCounters::lower_bound},
+    };
+    struct OperationMetric {
+        const char* metric;
+        const char* type;
+        const char* help;
+        uint64_t OperationCounters::*value;
+    };
+    static const OperationMetric kOperationMetrics[] = {
+        {"set_operations_total", "counter", "Operations by kind.", &OperationCounters::calls},
+        {"set_comparisons_total", "counter", "Key comparisons by operation kind.", &OperationCounters::comparisons},
+        {"set_descent_depth_total", "counter", "Vertices visited on the way down from the root by operation kind.",
+         &OperationCounters::total_depth},
+        {"set_descent_depth_max", "gauge", "Deepest descent by operation kind.", &OperationCounters::max_depth},
+    };
+    for (const OperationMetric& metric : kOperationMetrics) {
+        AppendHeader(out, metric.metric, metric.type, metric.help);
+        for (const SetMetricsSnapshot& s : snapshots) {
+            if (!s.has_counters) {
+                continue;
+            }
+            for (const Operation& op : kOperations) {
+                AppendSample(out, metric.metric, s.name, std::string("op=\"") + op.name + "\"",
+                             static_cast<double>((s.counters.*op.counters).*metric.value));
+            }
+        }
+    }
+    // Counter families of the whole set, with one series per label.
+    struct Series {
+        const char* label;
+        uint64_t SetCounters::*value;
+    };
+    struct Family {
+        const char* metric;
+        const char* help;
+        std::vector<Series> series;
+    };
+    static const Family kFamilies[] = {
+        {"set_rotations_total", "Rebalancing rotations by kind.",
+         {{"kind=\"single\"", &SetCounters::single_rotations}, {"kind=\"double\"", &SetCounters::double_rotations}}},
+        {"set_vertex_allocations_total", "Vertices allocated, the rate is the insert churn.",
+         {{"", &SetCounters::allocations}}},
+        {"set_vertex_deallocations_total", "Vertices freed, the rate is the erase churn.",
+         {{"", &SetCounters::deallocations}}},
+    };
+    for (const Family& family : kFamilies) {
+        AppendHeader(out, family.metric, "counter", family.help);
+        for (const SetMetricsSnapshot& s : snapshots) {
+            if (!s.has_counters) {
+                continue;
+            }
+            for (const Series& series : family.series) {
+                AppendSample(out, family.metric, s.name, series.label, static_cast<double>(s.counters.*series.value));
+            }
+        }
+    }
+    return out;
+}
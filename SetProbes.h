@@ -0,0 +1,28 @@
+#pragma once
+
+// USDT (SystemTap/DTrace style) static tracepoints of the set operations, provider "set_template":
+//   insert_entry(set, key*)      insert_return(set, inserted, size)
+//   erase_entry(set, key*)       erase_return(set, erased, size)
+//   find_entry(set, key*)        find_return(set, found)
+//   lower_bound_entry(set, key*) lower_bound_return(set, found)
+//   rotation(vertex, is_double)  in AvlTree::FixBalance, so also for IntrusiveSet
+// Keys are passed by address, a tracer reads them from the traced process, e.g. with bpftrace:
+//   bpftrace -e 'usdt:./app:set_template:find_entry { @start[tid] = nsecs; }
+//                usdt:./app:set_template:find_return /@start[tid]/ { @ns = hist(nsecs - @start[tid]); }'
+// The probes are compiled in only with SET_TEMPLATE_USDT defined (CMake option SET_TEMPLATE_USDT, which defines it
+// for every user of the set_template target, so that all translation units see the same template bodies) and need
+// <sys/sdt.h> (systemtap-sdt-dev or systemtap-sdt-devel). Every probe is a single nop instruction plus a note in the
+// ELF file, its arguments are only made available in registers or memory, so without a tracer attached the cost is
+// nil; an attached tracer replaces the nop with a breakpoint. Without SET_TEMPLATE_USDT the macros expand to nothing.
+
+#ifdef SET_TEMPLATE_USDT
+#if !__has_include(<sys/sdt.h>)
+#error "SET_TEMPLATE_USDT needs <sys/sdt.h>, install systemtap-sdt-dev"
+#endif
+#include <sys/sdt.h>
+#define SET_TEMPLATE_PROBE2(name, a, b) DTRACE_PROBE2(set_template, name, a, b)
+#define SET_TEMPLATE_PROBE3(name, a, b, c) DTRACE_PROBE3(set_template, name, a, b, c)
+#else
+#define SET_TEMPLATE_PROBE2(name, a, b) ((void)0)
+#define SET_TEMPLATE_PROBE3(name, a, b, c) ((void)0)
+#endif
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Sampling profiler of set operations. A Set with SetOptions::kSampling times every N-th operation of every thread
+// (N is the sample period, shared by all the sets) and records its duration, descent depth and key comparisons into
+// a ring buffer of the calling thread. Recording takes no locks: a ring has one writer, its thread, and one reader,
+// the exporter calling SetProfiler::Drain. If the exporter falls behind, the samples arriving at a full ring are
+// dropped and counted. Operations between the samples only decrement a thread-local countdown.
+
+// Sampled operation kinds.
+enum class SampledOp : uint8_t {
+    kInsert,
+    kErase,
+    kFind,
+    kLowerBound,
+    kIncrement,
+};
+
+// One sampled operation.
+struct SetSample {
+    const void* set;        // The set of the operation, nullptr for iterator increments.
+    uint64_t nanoseconds;   // The duration of the operation, including the clock reads.
+    uint32_t depth;         // The vertices visited on the way down from the root, 0 for increments.
+    uint32_t comparisons;   // The key comparisons, 0 for increments.
+    uint32_t thread;        // The number of the sampling thread, in the order of their first samples.
+    SampledOp op;
+};
+
+class SetProfiler {
+public:
+    static constexpr uint32_t kDefaultPeriod = 1024;
+    static constexpr size_t kRingSize = 4096;
+
+    // Sets the sample period N of all the threads, 0 stops the sampling. A thread picks the new period up after
+    // the countdown of the old one.
+    static void set_sample_period(uint32_t period) {
+        Period().store(period, std::memory_order_relaxed);
+    }
+    static uint32_t sample_period() {
+        return Period().load(std::memory_order_relaxed);
+    }
+    // Returns true for every N-th call of the calling thread.
+    static bool ShouldSample() {
+        uint32_t& countdown = Countdown();
+        if (--countdown != 0) {
+            return false;
+        }
+        uint32_t period = sample_period();
+        countdown = period == 0 ? kIdleCountdown : period;
+        return period != 0;
+    }
+    // Returns the timestamp in nanoseconds for the sample durations.
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // Appends the sample to the ring of the calling thread. The ring is created and registered with the first sample.
+    static void Record(const SetSample& sample) {
+        LocalRing& local = GetLocalRing();
+        if (local.dead) {
+            return;
+        }
+        if (local.ring == nullptr) {
+            local.ring = Register();
+        }
+        local.ring->Push(sample);
+    }
+    // Moves the samples of all the threads to out, returns their number. Rings of the exited threads are freed once
+    // they are drained. Exporters are serialized with a mutex, recording threads are never blocked.
+    static size_t Drain(std::vector<SetSample>& out) {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        size_t drained = 0;
+        for (size_t i = 0; i < registry.rings.size();) {
+            Ring* ring = registry.rings[i];
+            // A retired ring gets no more samples, so after this check the drain below empties it for good.
+            bool retired = ring->retired.load(std::memory_order_acquire);
+            drained += ring->Pop(out);
+            if (retired) {
+                registry.retired_dropped += ring->dropped.load(std::memory_order_relaxed);
+                delete ring;
+                registry.rings[i] = registry.rings.back();
+                registry.rings.pop_back();
+            } else {
+                ++i;
+            }
+        }
+        return drained;
+    }
+    // Returns the number of samples dropped at full rings.
+    static uint64_t dropped() {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        uint64_t dropped = registry.retired_dropped;
+        for (const Ring* ring : registry.rings) {
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+        }
+        return dropped;
+    }
+private:
+    // Countdown of the threads with the sampling stopped, after which they check the period again.
+    static constexpr uint32_t kIdleCountdown = 1 << 16;
+
+    // Single-producer single-consumer ring of samples. Head and tail only grow, the slot is their value modulo
+    // kRingSize.
+    struct Ring {
+        SetSample samples[kRingSize];
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> retired{false};
+        uint32_t thread = 0;
+
+        // Called by the owner thread only.
+        void Push(const SetSample& sample) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == kRingSize) {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+            SetSample& slot = samples[h % kRingSize];
+            slot = sample;
+            slot.thread = thread;
+            head.store(h + 1, std::memory_order_release);
+        }
+        // Called by the exporter only, under the registry mutex.
+        size_t Pop(std::vector<SetSample>& out) {
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            uint64_t h = head.load(std::memory_order_acquire);
+            for (uint64_t i = t; i != h; ++i) {
+                out.push_back(samples[i % kRingSize]);
+            }
+            tail.store(h, std::memory_order_release);
+            return h - t;
+        }
+    };
+    // The thread-local part is trivially destructible, so it stays usable after the thread exit guard has run.
+    struct LocalRing {
+        Ring* ring;
+        bool dead;
+    };
+    // Retires the ring of the thread when the thread exits, the next Drain frees it.
+    struct ThreadGuard {
+        ~ThreadGuard() {
+            LocalRing& local = GetLocalRing();
+            if (local.ring != nullptr) {
+                local.ring->retired.store(true, std::memory_order_release);
+            }
+            local.ring = nullptr;
+            local.dead = true;
+        }
+    };
+    struct Registry {
+        std::mutex mutex;
+        std::vector<Ring*> rings;
+        uint32_t threads = 0;
+        uint64_t retired_dropped = 0;
+    };
+
+    static std::atomic<uint32_t>& Period() {
+        static std::atomic<uint32_t> period(kDefaultPeriod);
+        return period;
+    }
+    // The countdown starts at 1, so the first operation of a thread is sampled.
+    static uint32_t& Countdown() {
+        static thread_local uint32_t countdown = 1;
+        return countdown;
+    }
+    static LocalRing& GetLocalRing() {
+        static thread_local LocalRing local{nullptr, false};
+        static thread_local ThreadGuard guard;
+        (void)guard;
+        return local;
+    }
+    // The registry is never destroyed, so it outlives every thread and every static object.
+    static Registry& GetRegistry() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+    static Ring* Register() {
+        Ring* ring = new Ring();
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        ring->thread = registry.threads++;
+        registry.rings.push_back(ring);
+        return ring;
+    }
+};
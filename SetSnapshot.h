@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Binary snapshot format of Set::save() and Set::load().
+//
+// Format: a 32-byte header (magic "SETSNAP", format version, byte order mark, key encoding, key size, key count),
+// the keys in increasing order, then a 64-bit checksum of everything before it. Trivially copyable keys are copied
+// as is, in the byte order of the machine, which the byte order mark checks; strings are a 64-bit length and the
+// bytes. Other key types get a SnapshotKeyCodec specialization, with the members of the ones below.
+// The checksum is a fast non-cryptographic hash, it detects truncated and corrupted files, not tampering.
+
+enum class SnapshotKeyEncoding : uint8_t {
+    kRaw = 0,
+    kString = 1,
+};
+
+struct SnapshotHeader {
+    static constexpr char kMagic[8] = {'S', 'E', 'T', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint16_t kByteOrderMark = 0x0102;
+
+    char magic[8];
+    uint32_t version;
+    uint16_t byte_order;
+    SnapshotKeyEncoding key_encoding;
+    uint8_t reserved = 0;
+    uint32_t key_size;
+    uint32_t reserved2 = 0;
+    uint64_t count;
+};
+static_assert(sizeof(SnapshotHeader) == 32, "the snapshot header must have no padding");
+
+// Streaming 64-bit hash of a byte sequence, independent of how the sequence is split into Update calls. A single
+// lane of the xxHash64 round (https://github.com/Cyan4973/xxHash) over 8-byte words with a final avalanche.
+class SnapshotChecksum {
+public:
+    void Update(const char* data, size_t n) {
+        total_ += n;
+        while (n != 0 && tail_size_ != 0) {
+            tail_[tail_size_++] = *data++;
+            --n;
+            if (tail_size_ == sizeof(uint64_t)) {
+                Round(Load(tail_));
+                tail_size_ = 0;
+            }
+        }
+        for (; n >= sizeof(uint64_t); data += sizeof(uint64_t), n -= sizeof(uint64_t)) {
+            Round(Load(data));
+        }
+        std::memcpy(tail_ + tail_size_, data, n);
+        tail_size_ += n;
+    }
+    uint64_t Digest() const {
+        uint64_t h = state_ ^ total_;
+        for (size_t i = 0; i < tail_size_; ++i) {
+            h = Rotl((h ^ (static_cast<uint8_t>(tail_[i]) * kPrime5)) * kPrime1, 11);
+        }
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        return h ^ (h >> 32);
+    }
+private:
+    static constexpr uint64_t kPrime1 = 0x9e3779b185ebca87ull;
+    static constexpr uint64_t kPrime2 = 0xc2b2ae3d27d4eb4full;
+    static constexpr uint64_t kPrime3 = 0x165667b19e3779f9ull;
+    static constexpr uint64_t kPrime5 = 0x27d4eb2f165667c5ull;
+
+    static uint64_t Rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+    static uint64_t Load(const char* p) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        return w;
+    }
+    void Round(uint64_t w) {
+        state_ = Rotl(state_ + w * kPrime2, 31) * kPrime1;
+    }
+
+    uint64_t state_ = kPrime5;
+    uint64_t total_ = 0;
+    char tail_[sizeof(uint64_t)] = {};
+    size_t tail_size_ = 0;
+};
+
+// Buffered writer of a snapshot, which checksums everything written. The sink gets whole buffers and throws on
+// errors.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::function<void(const char*, size_t)> sink)
+        : sink_(std::move(sink)), buffer_(kBufferSize) {
+    }
+    void Write(const void* data, size_t n) {
+        const char* p = static_cast<const char*>(data);
+        if (size_ + n > buffer_.size()) {
+            Flush();
+            if (n > buffer_.size()) {
+                checksum_.Update(p, n);
+                sink_(p, n);
+                return;
+            }
+        }
+        std::memcpy(buffer_.data() + size_, p, n);
+        size_ += n;
+    }
+    // Writes the checksum of everything written before and flushes the buffer.
+    void Finish() {
+        Flush();
+        uint64_t digest = checksum_.Digest();
+        sink_(reinterpret_cast<const char*>(&digest), sizeof(digest));
+    }
+private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    void Flush() {
+        checksum_.Update(buffer_.data(), size_);
+        sink_(buffer_.data(), size_);
+        size_ = 0;
+    }
+
+    std::function<void(const char*, size_t)> sink_;
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+    SnapshotChecksum checksum_;
+};
+
+// Buffered reader of a snapshot, which checksums everything read. The source fills up to the given number of bytes
+// and returns how many it filled, 0 at the end. Throws std::runtime_error at a premature end.
+class SnapshotReader {
+public:
+    explicit SnapshotReader(std::function<size_t(char*, size_t)> source)
+        : source_(std::move(source)), buffer_(kBufferSize) {
+    }
+    // Limits the bytes taken from the source beyond the buffered ones, so that the reader does not consume the data
+    // following the snapshot in the stream.
+    void Limit(uint64_t bytes) {
+        limit_ = bytes;
+    }
+    void Read(void* data, size_t n) {
+        char* p = static_cast<char*>(data);
+        while (n != 0) {
+            if (position_ == size_) {
+                Refill();
+            }
+            size_t chunk = std::min(n, size_ - position_);
+            std::memcpy(p, buffer_.data() + position_, chunk);
+            position_ += chunk;
+            p += chunk;
+            n -= chunk;
+        }
+    }
+    // Reads the checksum and compares it with the checksum of everything read before.
+    bool Verify() {
+        checksum_.Update(buffer_.data() + hashed_, position_ - hashed_);
+        hashed_ = position_;
+        uint64_t expected = checksum_.Digest();
+        uint64_t digest;
+        Read(&digest, sizeof(digest));
+        hashed_ = position_;
+        return digest == expected;
+    }
+private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+
+    void Refill() {
+        checksum_.Update(buffer_.data() + hashed_, size_ - hashed_);
+        size_t wanted = static_cast<size_t>(std::min<uint64_t>(buffer_.size(), limit_));
+        size_ = wanted == 0 ? 0 : source_(buffer_.data(), wanted);
+        limit_ -= size_;
+        position_ = 0;
+        hashed_ = 0;
+        if (size_ == 0) {
+            throw std::runtime_error("truncated set snapshot");
+        }
+    }
+
+    std::function<size_t(char*, size_t)> source_;
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+    size_t position_ = 0;
+    size_t hashed_ = 0;
+    uint64_t limit_ = UINT64_MAX;
+    SnapshotChecksum checksum_;
+};
+
+// Encoding of the keys of type T in a snapshot.
+template<class T, class Enable = void>
+struct SnapshotKeyCodec {
+    static_assert(std::is_trivially_copyable<T>::value, "SnapshotKeyCodec is not defined for this key type");
+    static constexpr SnapshotKeyEncoding kEncoding = SnapshotKeyEncoding::kRaw;
+    // The least number of bytes of an encoded key, which bounds the key count of a snapshot by its size.
+    static constexpr size_t kMinBytes = sizeof(T);
+
+    static void Write(SnapshotWriter& out, const T& k) {
+        out.Write(&k, sizeof(T));
+    }
+    static T Read(SnapshotReader& in) {
+        T k;
+        in.Read(&k, sizeof(T));
+        return k;
+    }
+};
+
+template<>
+struct SnapshotKeyCodec<std::string> {
+    static constexpr SnapshotKeyEncoding kEncoding = SnapshotKeyEncoding::kString;
+    static constexpr size_t kMinBytes = sizeof(uint64_t);
+
+    static void Write(SnapshotWriter& out, const std::string& k) {
+        uint64_t size = k.size();
+        out.Write(&size, sizeof(size));
+        out.Write(k.data(), k.size());
+    }
+    static std::string Read(SnapshotReader& in) {
+        uint64_t size;
+        in.Read(&size, sizeof(size));
+        std::string k;
+        // A corrupted length fails as a truncated file before allocating all of it.
+        while (k.size() < size) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(size - k.size(), 1 << 20));
+            size_t old_size = k.size();
+            k.resize(old_size + chunk);
+            in.Read(&k[old_size], chunk);
+        }
+        return k;
+    }
+};
+
+// Returns the header of a snapshot of count keys of type T.
+template<class T>
+SnapshotHeader MakeSnapshotHeader(uint64_t count) {
+    SnapshotHeader header;
+    std::memcpy(header.magic, SnapshotHeader::kMagic, sizeof(header.magic));
+    header.version = SnapshotHeader::kVersion;
+    header.byte_order = SnapshotHeader::kByteOrderMark;
+    header.key_encoding = SnapshotKeyCodec<T>::kEncoding;
+    header.key_size = sizeof(T);
+    header.count = count;
+    return header;
+}
+
+// Throws std::runtime_error if the header does not start a snapshot of keys of type T, which this version reads,
+// or if its key count does not fit into the given size of the snapshot, if it is known.
+template<class T>
+void CheckSnapshotHeader(const SnapshotHeader& header, uint64_t size = UINT64_MAX) {
+    if (std::memcmp(header.magic, SnapshotHeader::kMagic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("not a set snapshot");
+    }
+    if (header.version != SnapshotHeader::kVersion) {
+        throw std::runtime_error("unsupported set snapshot version " + std::to_string(header.version));
+    }
+    if (header.byte_order != SnapshotHeader::kByteOrderMark) {
+        throw std::runtime_error("set snapshot of a different byte order");
+    }
+    if (header.key_encoding != SnapshotKeyCodec<T>::kEncoding || header.key_size != sizeof(T)) {
+        throw std::runtime_error("set snapshot of a different key type");
+    }
+    // Also keeps the count far from overflowing when the size is not known.
+    constexpr uint64_t kFrame = sizeof(SnapshotHeader) + sizeof(uint64_t);
+    if (size < kFrame || header.count > (size - kFrame) / SnapshotKeyCodec<T>::kMinBytes) {
+        throw std::runtime_error("truncated set snapshot");
+    }
+}
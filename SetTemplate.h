@@ -1,211 +1,595 @@
+#pragma once
+
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <istream>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "AvlTree.h"
+#include "NodeAllocator.h"
+#include "SetProbes.h"
+#include "SetProfiler.h"
+#include "SetSnapshot.h"
+
+#if __has_include(<unistd.h>)
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SET_TEMPLATE_HAVE_FD_IO 1
+#endif
 
 // Template set class, based on AVL-tree. https://en.wikipedia.org/wiki/AVL_tree
+// The balancing algorithms live in AvlTree.h and are shared with IntrusiveSet.
+// Tree vertices are allocated with the Allocator rebound to the vertex type, by default with the thread-caching
+// NodeAllocator.
+
+// Compile-time options of Set. Derive from SetOptions and override the members to change them.
+struct SetOptions {
+    // Tree vertices keep a link to their parent. Without it every vertex is a pointer smaller and rotations write
+    // less, but iterators keep the whole path from the root (about 0.5 KiB) and are invalidated by insert and erase.
+    static constexpr bool kParentLinks = true;
+    // The set counts key comparisons, descent depths, rotations and vertex allocations, see SetCounters. Without it
+    // no counting code is compiled in and the set is not larger.
+    static constexpr bool kCounters = false;
+    // Every N-th operation is timed and recorded with its depth and comparisons by SetProfiler. Without it no
+    // sampling code is compiled in.
+    static constexpr bool kSampling = false;
+    // Every vertex counts the find and lower_bound calls returning it, see Set::access_report(). The 4-byte counter
+    // takes up to 8 bytes per vertex with the alignment.
+    static constexpr bool kAccessCounts = false;
+};
+
+// Set options for lookup-heavy sets, which are rarely iterated.
+struct ParentlessSetOptions : SetOptions {
+    static constexpr bool kParentLinks = false;
+};
+
+// Set options for a set with operation counters.
+struct CountingSetOptions : SetOptions {
+    static constexpr bool kCounters = true;
+};
+
+// Set options for a set sampled by SetProfiler.
+struct SampledSetOptions : SetOptions {
+    static constexpr bool kSampling = true;
+};
+
+// Set options for a set with access counts in the vertices.
+struct AccessCountingSetOptions : SetOptions {
+    static constexpr bool kAccessCounts = true;
+};
+
+// Counters of one kind of set operations. Depth is the number of vertices visited on the way down from the root.
+struct OperationCounters {
+    uint64_t calls = 0;
+    uint64_t comparisons = 0;
+    uint64_t total_depth = 0;
+    uint64_t max_depth = 0;
+
+    double mean_comparisons() const {
+        return calls == 0 ? 0.0 : static_cast<double>(comparisons) / calls;
+    }
+    double mean_depth() const {
+        return calls == 0 ? 0.0 : static_cast<double>(total_depth) / calls;
+    }
+};
 
+// Operation counters of a set with SetOptions::kCounters. The comparisons of insert include the search for an equal
+// key before the insertion, its depth is the depth of the new vertex.
+struct SetCounters {
+    OperationCounters find;
+    OperationCounters insert;
+    OperationCounters erase;
+    OperationCounters lower_bound;
+    uint64_t single_rotations = 0;
+    uint64_t double_rotations = 0;
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+};
+
+// Structural statistics of a set, see Set::stats(). The end vertex takes part in the tree structure, so it is counted
+// in the depths and the height, but not in vertices and depth_histogram.
+struct SetStats {
+    size_t size = 0;                    // The element count kept by the set.
+    size_t vertices = 0;                // The vertices found by walking the tree, equals size for a sound tree.
+    size_t height = 0;                  // The number of vertices on the longest path from the root.
+    double height_bound = 0;            // The AVL height bound of the tree, see HeightBound.
+    std::vector<size_t> depth_histogram;  // The number of key vertices at every depth, the root is at depth 0.
+    double mean_depth = 0;              // The mean depth of a vertex, the cost of a successful search.
+    double mean_external_path_length = 0;  // The mean depth of a null link, the cost of an unsuccessful search.
+    size_t balance[3] = {0, 0, 0};      // The number of vertices with balance factor -1, 0 and +1.
+    size_t unbalanced = 0;              // The number of vertices with any other balance factor.
+    size_t wrong_heights = 0;           // The number of vertices, whose stored height is wrong.
+    size_t bytes = 0;                   // The estimate of the memory used: the set object and sizeof(vertex) each.
+
+    // Returns true if the stored heights are right and every vertex is balanced.
+    bool balanced() const {
+        return unbalanced == 0 && wrong_heights == 0;
+    }
+    // Returns the AVL height bound 1.44 log2(n + 2) for the n = size + 1 vertices of a set with the given size, the
+    // end vertex included, that is 1.44 log2(size + 3).
+    static double HeightBound(size_t size) {
+        return 1.44 * std::log2(static_cast<double>(size) + 3);
+    }
+};
+
+// Access profile of a set with SetOptions::kAccessCounts, see Set::access_report(). An access is a find or
+// lower_bound call returning the key. Depths count from the root at depth 0, as in SetStats.
+template<class T>
+struct SetAccessReport {
+    // Subtree rooted at a fixed depth, holding the keys from min_key to max_key.
+    struct Subtree {
+        T min_key;
+        T max_key;
+        size_t keys;
+        uint64_t accesses;
+    };
+
+    uint64_t accesses = 0;          // The accesses of all the keys.
+    size_t accessed_keys = 0;       // The keys accessed at least once.
+    size_t saturated_keys = 0;      // The keys, whose counter saturated: their counts are lower bounds.
+    double mean_depth = 0;          // The mean depth of the keys, the cost of uniform accesses.
+    double weighted_depth = 0;      // The mean depth of the accesses, the cost of the profiled accesses.
+    // The entropy of the access distribution in bits. A tree optimal for the distribution needs at least
+    // entropy_bits / log2(3) comparisons per access (Mehlhorn), a skewed distribution has a low entropy.
+    double entropy_bits = 0;
+    std::vector<std::pair<T, uint32_t>> hottest_keys;  // The most accessed keys, most accessed first.
+    std::vector<Subtree> hottest_subtrees;             // The subtrees at the requested depth, most accessed first.
+};
+
+// Path of one lookup, see Set::explain_find() and Set::explain_lower_bound().
 template<class T>
-class Set {
+struct SetExplanation {
+    // Vertex visited on the way down from the root.
+    struct Step {
+        const void* address;    // The address of the vertex, to see the memory layout of the path.
+        std::optional<T> key;   // The key of the vertex, none for the end vertex.
+        // The key comparisons made at the vertex: 1 when going left, 2 when going right or stopping, 0 at the end
+        // vertex, which is greater than all the keys without a comparison.
+        size_t comparisons;
+    };
+
+    std::vector<Step> path;         // The visited vertices, the root first.
+    size_t comparisons = 0;         // The key comparisons of the whole lookup.
+    bool visited_end = false;       // The lookup went through the end vertex, taking the branch without comparison.
+    bool found = false;             // The key is found by explain_find, the result is not the end for lower_bound.
+    std::optional<T> result;        // The key of the result, none for the end.
+    size_t cache_lines = 0;         // The distinct 64-byte cache lines spanned by the visited vertices.
+    size_t pages = 0;               // The distinct 4 KiB pages of the visited vertices.
+};
+
+namespace set_detail {
+
+// Storage of the counters of a set, an empty base class if the set does not count.
+template<bool kCounters>
+struct CountersBase {
+};
+
+// Counter of a set, updated by the const lookups too. It is incremented with a relaxed load and store, not an atomic
+// addition, like the access counts: lookups running concurrently under a shared lock do not race and do not contend
+// on a locked instruction, but may lose counts.
+class RelaxedCounter {
+public:
+    uint64_t Load() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+    void Add(uint64_t n) {
+        value_.store(Load() + n, std::memory_order_relaxed);
+    }
+    void Max(uint64_t n) {
+        if (n > Load()) {
+            value_.store(n, std::memory_order_relaxed);
+        }
+    }
+    void Reset() {
+        value_.store(0, std::memory_order_relaxed);
+    }
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// Storage of OperationCounters and SetCounters.
+struct RelaxedOperationCounters {
+    RelaxedCounter calls;
+    RelaxedCounter comparisons;
+    RelaxedCounter total_depth;
+    RelaxedCounter max_depth;
+
+    OperationCounters Load() const {
+        return OperationCounters{calls.Load(), comparisons.Load(), total_depth.Load(), max_depth.Load()};
+    }
+    void Reset() {
+        for (RelaxedCounter* c : {&calls, &comparisons, &total_depth, &max_depth}) {
+            c->Reset();
+        }
+    }
+};
+
+struct RelaxedSetCounters {
+    RelaxedOperationCounters find;
+    RelaxedOperationCounters insert;
+    RelaxedOperationCounters erase;
+    RelaxedOperationCounters lower_bound;
+    RelaxedCounter single_rotations;
+    RelaxedCounter double_rotations;
+    RelaxedCounter allocations;
+    RelaxedCounter deallocations;
+
+    SetCounters Load() const {
+        return SetCounters{find.Load(), insert.Load(), erase.Load(), lower_bound.Load(), single_rotations.Load(),
+                           double_rotations.Load(), allocations.Load(), deallocations.Load()};
+    }
+    void Reset() {
+        for (RelaxedOperationCounters* c : {&find, &insert, &erase, &lower_bound}) {
+            c->Reset();
+        }
+        for (RelaxedCounter* c : {&single_rotations, &double_rotations, &allocations, &deallocations}) {
+            c->Reset();
+        }
+    }
+};
+
+template<>
+struct CountersBase<true> {
+    mutable RelaxedSetCounters counters_;
+};
+
+// Access counter of a tree vertex, nothing if the set does not count accesses.
+template<bool kAccessCounts>
+struct AccessCount {
+};
+
+template<>
+struct AccessCount<true> {
+    mutable std::atomic<uint32_t> accesses{0};
+};
+
+}  // namespace set_detail
+
+template<class T, class Allocator = NodeAllocator<T>, class Options = SetOptions>
+class Set : private set_detail::CountersBase<Options::kCounters> {
 private:
-    struct Node {
+    using Hook = std::conditional_t<Options::kParentLinks, AvlHook, AvlParentlessHook>;
+    using Tree = AvlTree<Hook>;
+    using Path = AvlPath<Hook>;
+    using Counters = set_detail::RelaxedSetCounters;
+    struct Node : Hook, set_detail::AccessCount<Options::kAccessCounts> {
         T key;
-        size_t height = 1;
-        Node* left_son = nullptr;
-        Node* right_son = nullptr;
-        Node* parent = nullptr;
-        bool is_end = false;
-        Node(T k, Node* par) {
-            key = k;
-            parent = par;
-        }
-        explicit Node(Node* par) {
-            parent = par;
-            is_end = true;
+        explicit Node(const T& k) : key(k) {
+        }
+    };
+    // Maps a tree vertex, which is not the end vertex, to its key.
+    struct KeyOfNode {
+        const T& operator()(const Hook* v) const {
+            return static_cast<const Node*>(v)->key;
         }
     };
+    using NodeAlloc = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeAllocTraits = std::allocator_traits<NodeAlloc>;
+    // Next three classes count the comparisons and the depth of an operation into SetCounters and the samples of
+    // SetProfiler.
+    struct CountingKeyOf {
+        uint64_t* comparisons;
+        const T& operator()(const Hook* v) const {
+            ++*comparisons;
+            return static_cast<const Node*>(v)->key;
+        }
+    };
+    struct CountingObserver {
+        uint64_t* depth;
+        Counters* counters;
+        void OnVisit(const Hook*) const {
+            ++*depth;
+        }
+        void OnRotation(bool is_double) const {
+            if constexpr (Options::kCounters) {
+                (is_double ? counters->double_rotations : counters->single_rotations).Add(1);
+            }
+        }
+    };
+    // Next two classes record the path and the comparisons of a lookup into SetExplanation.
+    struct ExplainObserver {
+        SetExplanation<T>* explanation;
+        void OnVisit(const Hook* v) const {
+            std::optional<T> key;
+            if (!v->is_end) {
+                key = KeyOfNode()(v);
+            }
+            explanation->path.push_back(typename SetExplanation<T>::Step{v, std::move(key), 0});
+            explanation->visited_end = explanation->visited_end || v->is_end;
+        }
+        void OnRotation(bool) const {
+        }
+    };
+    struct ExplainKeyOf {
+        SetExplanation<T>* explanation;
+        const T& operator()(const Hook* v) const {
+            ++explanation->comparisons;
+            ++explanation->path.back().comparisons;
+            return KeyOfNode()(v);
+        }
+    };
+    class CountingProbe {
+    public:
+        CountingProbe(const Set& set, set_detail::RelaxedOperationCounters Counters::*op, SampledOp sampled_op)
+            : set_(set), op_(op), sampled_op_(sampled_op) {
+            if constexpr (Options::kSampling) {
+                if (SetProfiler::ShouldSample()) {
+                    start_ = SetProfiler::Now();
+                }
+            }
+        }
+        ~CountingProbe() {
+            if constexpr (Options::kCounters) {
+                set_detail::RelaxedOperationCounters& op = set_.counters_.*op_;
+                op.calls.Add(1);
+                op.comparisons.Add(comparisons_);
+                op.total_depth.Add(depth_);
+                op.max_depth.Max(depth_);
+            }
+            if constexpr (Options::kSampling) {
+                if (start_ != 0) {
+                    SetProfiler::Record(SetSample{&set_, SetProfiler::Now() - start_, static_cast<uint32_t>(depth_),
+                                                  static_cast<uint32_t>(comparisons_), 0, sampled_op_});
+                }
+            }
+        }
+        CountingKeyOf KeyOf() {
+            return CountingKeyOf{&comparisons_};
+        }
+        CountingObserver Observer() {
+            if constexpr (Options::kCounters) {
+                return CountingObserver{&depth_, &set_.counters_};
+            } else {
+                return CountingObserver{&depth_, nullptr};
+            }
+        }
+    private:
+        const Set& set_;
+        set_detail::RelaxedOperationCounters Counters::*op_;
+        SampledOp sampled_op_;
+        uint64_t start_ = 0;
+        uint64_t comparisons_ = 0;
+        uint64_t depth_ = 0;
+    };
+    // Times every N-th iterator increment of a sampled set for SetProfiler.
+    class IncrementProbe {
+    public:
+        IncrementProbe() {
+            if constexpr (Options::kSampling) {
+                if (SetProfiler::ShouldSample()) {
+                    start_ = SetProfiler::Now();
+                }
+            }
+        }
+        ~IncrementProbe() {
+            if constexpr (Options::kSampling) {
+                if (start_ != 0) {
+                    SetProfiler::Record(SetSample{nullptr, SetProfiler::Now() - start_, 0, 0, 0,
+                                                  SampledOp::kIncrement});
+                }
+            }
+        }
+    private:
+        uint64_t start_ = 0;
+    };
+    // Probe of a set without counters, the tree algorithms get the plain key functor and the empty observer.
+    struct NullProbe {
+        KeyOfNode KeyOf() const {
+            return KeyOfNode();
+        }
+        AvlNullObserver Observer() const {
+            return AvlNullObserver();
+        }
+    };
+    using Probe = std::conditional_t<Options::kCounters || Options::kSampling, CountingProbe, NullProbe>;
 public:
-    // Iterator class for the set, using pointer to const Node to operate.
+    // Iterator class for the set with parent links, using pointer to const tree vertex to operate.
     // Supports the similar methods as the STL set iterator.
-    class iterator {
+    class LinkedIterator {
     public:
-        iterator() = default;
-        explicit iterator(Node* v) : it_(v) {}
-        iterator(const iterator& iter) : it_(iter.it_) {}
-        iterator& operator=(const iterator& iter) {
+        LinkedIterator() = default;
+        explicit LinkedIterator(const Hook* v) : it_(v) {}
+        LinkedIterator(const LinkedIterator& iter) : it_(iter.it_) {}
+        LinkedIterator& operator=(const LinkedIterator& iter) {
             if (this == &iter) {
                 return *this;
             }
             it_ = iter.it_;
             return *this;
         }
-        bool operator==(const iterator& iter) const {
+        bool operator==(const LinkedIterator& iter) const {
             return it_ == iter.it_;
         }
-        bool operator!=(const iterator& iter) const {
+        bool operator!=(const LinkedIterator& iter) const {
             return it_ != iter.it_;
         }
         // Next four methods implement increments and decrements of an iterator.
         // Incrementing past-the-last element iterator or decrementing first element iterator causes undefined behaviour.
         // The transition to the next element may take up to O(log n) operations, but passage through the entire set
         // takes O(n) operations.
-        iterator& operator++() {
-            if (it_->is_end) {
-                return *this;
-            }
-            if (it_->right_son != nullptr) {
-                it_ = it_->right_son;
-                it_ = GetLeftmost(it_);
-                return *this;
-            }
-            T t = it_->key;
-            it_ = GetGreaterParent(it_, t);
+        LinkedIterator& operator++() {
+            IncrementProbe probe;
+            it_ = Tree::Next(it_);
             return *this;
         }
-        iterator& operator--() {
-            if (it_->is_end) {
-                it_ = DecreaseEnd(it_);
-                return *this;
-            }
-            if (it_->left_son != nullptr) {
-                it_ = it_->left_son;
-                it_ = GetRightmost(it_);
-                return *this;
-            }
-            T t = it_->key;
-            if (it_->parent == nullptr) {
-                return *this;
-            }
-            it_ = HopEndParent(it_);
-            it_ = GetLesserParent(it_, t);
+        LinkedIterator& operator--() {
+            it_ = Tree::Prev(it_);
             return *this;
         }
-        iterator& operator++(int) {
-            if (it_->is_end) {
-                return *this;
-            }
-            if (it_->right_son != nullptr) {
-                it_ = it_->right_son;
-                it_ = GetLeftmost(it_);
-                return *this;
-            }
-            T t = it_->key;
-            it_ = GetGreaterParent(it_, t);
-            return *this;
+        LinkedIterator& operator++(int) {
+            return ++*this;
         }
-        iterator& operator--(int) {
-            if (it_->is_end) {
-                it_ = DecreaseEnd(it_);
-                return *this;
-            }
-            if (it_->left_son != nullptr) {
-                it_ = it_->left_son;
-                it_ = GetRightmost(it_);
-                return *this;
-            }
-            T t = it_->key;
-            if (it_->parent == nullptr) {
-                return *this;
-            }
-            it_ = HopEndParent(it_);
-            it_ = GetLesserParent(it_, t);
+        LinkedIterator& operator--(int) {
+            it_ = Tree::Prev(it_);
             return *this;
         }
         T operator*() const {
-            return it_->key;
+            return KeyOfNode()(it_);
         }
         const T* operator->() const {
-            return &(it_->key);
+            return &KeyOfNode()(it_);
         }
     private:
-        const Node* DecreaseEnd(const Node* v){
-            if (v->left_son != nullptr) {
-                return v->left_son;
-            } else {
-                return v->parent;
-            }
+        const Hook* it_ = nullptr;
+    };
+    // Iterator class for the set without parent links, keeps the path from the root to the current vertex.
+    // Supports the same methods as LinkedIterator.
+    class PathIterator {
+    public:
+        PathIterator() = default;
+        bool operator==(const PathIterator& iter) const {
+            return Current() == iter.Current();
         }
-        const Node* GetRightmost(const Node* v){
-            while (v->right_son != nullptr) {
-                v = v->right_son;
-            }
-            return v;
+        bool operator!=(const PathIterator& iter) const {
+            return Current() != iter.Current();
         }
-        const Node* GetLeftmost(const Node* v){
-            while (v->left_son != nullptr) {
-                v = v->left_son;
-            }
-            return v;
+        PathIterator& operator++() {
+            IncrementProbe probe;
+            Tree::Next(path_);
+            return *this;
         }
-        const Node* HopEndParent(const Node* v){
-            if (v->parent->is_end) {
-                if (v->parent->parent == nullptr) {
-                    return v;
-                }
-                v = v->parent->parent;
+        PathIterator& operator--() {
+            if (path_.depth == 1 && path_.Top()->is_end) {
+                Tree::PathToEnd(*root_, path_);
             }
-            return v;
+            Tree::Prev(path_);
+            return *this;
         }
-        const Node* GetGreaterParent(const Node* v, const T& t){
-            while (!v->is_end && !(t < v->key) && v->parent != nullptr) {
-                v = v->parent;
-            }
-            return v;
+        PathIterator& operator++(int) {
+            return ++*this;
         }
-        const Node* GetLesserParent(const Node* v, const T& t){
-            while (!v->is_end && !(v->key < t) && v->parent != nullptr) {
-                v = v->parent;
-            }
-            return v;
+        PathIterator& operator--(int) {
+            return --*this;
+        }
+        T operator*() const {
+            return KeyOfNode()(path_.Top());
+        }
+        const T* operator->() const {
+            return &KeyOfNode()(path_.Top());
         }
     private:
-        const Node* it_;
+        friend class Set;
+        explicit PathIterator(Hook* const* root) : root_(root) {}
+        const Hook* Current() const {
+            return path_.depth == 0 ? nullptr : path_.Top();
+        }
+        // The past-the-end iterator keeps only the end vertex, the path to it is restored by the first decrement.
+        Path path_;
+        Hook* const* root_ = nullptr;
     };
+    using iterator = std::conditional_t<Options::kParentLinks, LinkedIterator, PathIterator>;
+    using options_type = Options;
     // Default set constructor.
-    Set() {
-        root_ = new Node(nullptr);
-        size_ = 0;
-        end_ = root_;
+    // The end vertex is a member of the set, so an empty set does not allocate.
+    Set() noexcept(noexcept(Allocator())) : Set(Allocator()) {
+    }
+    // Constructs an empty set, which allocates its vertices with the given allocator.
+    explicit Set(const Allocator& alloc) noexcept : alloc_(alloc) {
     }
     // Inserts element with the given value to the set.
     void insert(const T& k) {
-        if (Find(root_, k) == nullptr) {
+        SET_TEMPLATE_PROBE2(insert_entry, this, &k);
+        Probe probe = MakeProbe(&Counters::insert, SampledOp::kInsert);
+        bool inserted = Tree::Find(root_, k, probe.KeyOf()) == nullptr;
+        if (inserted) {
+            Node* node = NewNode(k);
             ++size_;
-            root_ = Insert(root_, k, nullptr);
+            root_ = Tree::Insert(root_, node, nullptr, k, probe.KeyOf(), probe.Observer());
         }
+        SET_TEMPLATE_PROBE3(insert_return, this, inserted, size_);
     }
     // Constructor from the given sequence of elements specified by the begin and end iterators.
     template<typename Iterator>
-    Set(Iterator beginit, Iterator endit) {
-        size_ = 0;
-        root_ = new Node(nullptr);
-        end_ = root_;
-        std::for_each(beginit, endit, [this](const T& k) { (*this).insert(k); });
+    Set(Iterator beginit, Iterator endit, const Allocator& alloc = Allocator()) : alloc_(alloc) {
+        InsertOrDestroy(beginit, endit);
     }
     // Initializer list constructor.
-    Set(std::initializer_list<T> lst) {
-        size_ = 0;
-        root_ = new Node(nullptr);
-        end_ = root_;
-        std::for_each(lst.begin(), lst.end(), [this](const T& k) { (*this).insert(k); });
+    Set(std::initializer_list<T> lst, const Allocator& alloc = Allocator()) : alloc_(alloc) {
+        InsertOrDestroy(lst.begin(), lst.end());
     }
     // Copy constructor.
-    Set(const Set& st) {
+    Set(const Set& st) : alloc_(NodeAllocTraits::select_on_container_copy_construction(st.alloc_)) {
         size_ = st.size_;
         root_ = CopyNode(st.root_, nullptr);
-        end_ = FindEnd(root_);
     }
-    // Copy assignment operator.
+    // Copy constructor with the given allocator for the copy.
+    Set(const Set& st, const Allocator& alloc) : alloc_(alloc) {
+        size_ = st.size_;
+        root_ = CopyNode(st.root_, nullptr);
+    }
+    // Move constructor. Takes the vertices of the other set, which is left empty, and its allocator. The end vertex
+    // is a member of the set, so it is relinked: in O(1) with parent links, in O(log n) without them. Iterators to
+    // the keys stay valid with parent links; the past-the-end iterator and the path iterators do not.
+    Set(Set&& st) noexcept : alloc_(std::move(st.alloc_)) {
+        TakeTree(st);
+    }
+    // Copy assignment operator. The keys are copied into a new set first, so if the copy runs out of memory, the set
+    // is left unchanged.
     Set& operator=(const Set& st) {
+        if (this != &st) {
+            Set copy(st, alloc_);
+            ReplaceWith(copy);
+        }
+        return *this;
+    }
+    // Move assignment operator. Takes the vertices of the other set, which is left empty, if the allocator propagates
+    // on move assignment or the allocators are equal, like the move constructor; otherwise copies the keys.
+    Set& operator=(Set&& st) noexcept(NodeAllocTraits::propagate_on_container_move_assignment::value ||
+                                      NodeAllocTraits::is_always_equal::value) {
         if (this == &st) {
             return *this;
         }
-        DestroySet(root_);
-        size_ = st.size_;
-        root_ = CopyNode(st.root_, nullptr);
-        end_ = FindEnd(root_);
+        if constexpr (NodeAllocTraits::propagate_on_container_move_assignment::value) {
+            DestroyTree();
+            alloc_ = std::move(st.alloc_);
+            TakeTree(st);
+        } else {
+            if (alloc_ == st.alloc_) {
+                DestroyTree();
+                TakeTree(st);
+            } else {
+                *this = static_cast<const Set&>(st);
+            }
+        }
         return *this;
     }
     ~Set() {
-        DestroySet(root_);
+        if (!SkipsTeardown()) {
+            DestroySet(root_);
+        }
+    }
+    // Prepares the allocator for the set to grow up to n elements. With NodeAllocator the calling thread then inserts
+    // the missing elements without calling the global allocator or taking the depot lock. The reservation is made in
+    // the cache of the calling thread, for the size class of the vertices (not of T), so inserts from other threads
+    // do not use it; the thread keeps up to that many free vertices until shrink_to_fit() or its exit. Does nothing
+    // for allocators without reserve().
+    void reserve(size_t n) {
+        if (n > size_) {
+            ReserveNodes(alloc_, n - size_, 0);
+        }
+    }
+    // Returns the unused memory of the allocator to the operating system. With NodeAllocator the pool is shared by all
+    // the sets of the same vertex size, and the call goes through the allocator rebound to the vertex type, so it
+    // frees the size class of the vertices: get_allocator().shrink_to_fit() would act on the size class of T instead.
+    // It also ends a reservation of the calling thread. Does nothing for allocators without shrink_to_fit().
+    void shrink_to_fit() {
+        ShrinkNodes(alloc_, 0);
+    }
+    // Returns a copy of the allocator associated with the set.
+    Allocator get_allocator() const {
+        return Allocator(alloc_);
     }
     // Returns the number of elements in the set.
     size_t size() const {
@@ -218,248 +602,629 @@ public:
     // Returns an iterator to the element with the given key or past-the-end iterator if no such element is found.
     // Complexity O(log n).
     iterator find(T k) const {
-        Node* v = Find(root_, k);
-        if (v == nullptr) {
-            return iterator(end_);
+        SET_TEMPLATE_PROBE2(find_entry, this, &k);
+        Probe probe = MakeProbe(&Counters::find, SampledOp::kFind);
+        if constexpr (Options::kParentLinks) {
+            Hook* v = Tree::Find(root_, k, probe.KeyOf(), probe.Observer());
+            SET_TEMPLATE_PROBE2(find_return, this, v != nullptr);
+            if (v == nullptr) {
+                return iterator(&end_);
+            }
+            CountAccess(v);
+            return iterator(v);
+        } else {
+            PathIterator iter(&root_);
+            Tree::FindPath(root_, k, probe.KeyOf(), iter.path_, probe.Observer());
+            SET_TEMPLATE_PROBE2(find_return, this, !iter.path_.Top()->is_end);
+            CountAccess(iter.path_.Top());
+            return iter;
         }
-        return iterator(v);
     }
     // Erases an element with the given key or does nothing if no such element is found. Complexity O(log n).
     void erase(T k) {
-        if (Find(root_, k) != nullptr) {
+        SET_TEMPLATE_PROBE2(erase_entry, this, &k);
+        Probe probe = MakeProbe(&Counters::erase, SampledOp::kErase);
+        Hook* v = nullptr;
+        root_ = Tree::Erase(root_, nullptr, k, probe.KeyOf(), v, probe.Observer());
+        if (v != nullptr) {
             --size_;
-            root_ = Erase(root_, k);
+            DeleteNode(static_cast<Node*>(v));
         }
+        SET_TEMPLATE_PROBE3(erase_return, this, v != nullptr, size_);
     }
     // Returns iterator to the first element.
     iterator begin() const {
-        return iterator(FindMin(root_));
+        if constexpr (Options::kParentLinks) {
+            return iterator(Tree::FindMin(root_));
+        } else {
+            PathIterator iter(&root_);
+            Tree::PathToMin(root_, iter.path_);
+            return iter;
+        }
     }
     // Return past-the-end iterator.
     iterator end() const {
-        return iterator(end_);
+        if constexpr (Options::kParentLinks) {
+            return iterator(&end_);
+        } else {
+            PathIterator iter(&root_);
+            iter.path_.Push(&end_);
+            return iter;
+        }
     }
     // Returns iterator to the first element with the value more or equal to the given key. Complexity O(log n).
     iterator lower_bound(const T& k) const {
-        auto iter = iterator(LowerBound(root_, nullptr, k));
-        auto e = iterator(end_);
-        while (iter != e && *iter < k) {
-            ++iter;
+        SET_TEMPLATE_PROBE2(lower_bound_entry, this, &k);
+        Probe probe = MakeProbe(&Counters::lower_bound, SampledOp::kLowerBound);
+        if constexpr (Options::kParentLinks) {
+            const Hook* v = Tree::LowerBound(root_, nullptr, k, probe.KeyOf(), probe.Observer());
+            SET_TEMPLATE_PROBE2(lower_bound_return, this, !v->is_end);
+            CountAccess(v);
+            return iterator(v);
+        } else {
+            PathIterator iter(&root_);
+            Tree::LowerBoundPath(root_, k, probe.KeyOf(), iter.path_, probe.Observer());
+            SET_TEMPLATE_PROBE2(lower_bound_return, this, !iter.path_.Top()->is_end);
+            CountAccess(iter.path_.Top());
+            return iter;
         }
-        return iter;
     }
-private:
-    // Returns height of a tree vertex.
-    size_t GetHeight(Node* v) const {
-        if (v != nullptr) {
-            return v->height;
+    // Returns the structural statistics of the tree. Complexity O(n) without recursion, allocates only O(log n)
+    // memory for the walk and the depth histogram.
+    SetStats stats() const {
+        SetStats st;
+        st.size = size_;
+        st.height_bound = SetStats::HeightBound(size_);
+        size_t depths = 0;
+        size_t external_depths = 0;
+        std::vector<std::pair<const Hook*, size_t>> stack;
+        stack.emplace_back(root_, 0);
+        while (!stack.empty()) {
+            auto [v, depth] = stack.back();
+            stack.pop_back();
+            if (!v->is_end) {
+                ++st.vertices;
+                if (st.depth_histogram.size() <= depth) {
+                    st.depth_histogram.resize(depth + 1);
+                }
+                ++st.depth_histogram[depth];
+            }
+            depths += depth;
+            st.height = std::max(st.height, depth + 1);
+            int32_t balance = Tree::GetBalance(v);
+            if (balance >= -1 && balance <= 1) {
+                ++st.balance[balance + 1];
+            } else {
+                ++st.unbalanced;
+            }
+            // Heights are checked locally, which by induction from the leaves checks them all.
+            if (v->height != std::max(Tree::GetHeight(v->left_son), Tree::GetHeight(v->right_son)) + 1) {
+                ++st.wrong_heights;
+            }
+            for (const Hook* son : {v->left_son, v->right_son}) {
+                if (son == nullptr) {
+                    external_depths += depth + 1;
+                } else {
+                    stack.emplace_back(son, depth + 1);
+                }
+            }
         }
-        return 0;
+        size_t all = st.vertices + 1;
+        st.mean_depth = static_cast<double>(depths) / all;
+        st.mean_external_path_length = static_cast<double>(external_depths) / (all + 1);
+        st.bytes = sizeof(Set) + st.vertices * sizeof(Node);
+        return st;
     }
-    // Returns balance factor of a tree vertex.
-    int32_t GetBalance(Node* v) const {
-        if (v != nullptr) {
-            return GetHeight(v->left_son) - GetHeight(v->right_son);
+    // Writes the keys in increasing order to the stream, in the snapshot format of SetSnapshot.h. Throws
+    // std::runtime_error if the stream fails. Complexity O(n).
+    void save(std::ostream& out) const {
+        Save([&out](const char* data, size_t n) {
+            if (!out.write(data, static_cast<std::streamsize>(n))) {
+                throw std::runtime_error("can not write the set snapshot");
+            }
+        });
+    }
+    // Replaces the contents of the set with a snapshot written by save(). The keys are read into the vertices of a
+    // balanced tree, built in order, so the complexity is O(n) and loading is bound by the input; trivially copyable
+    // keys are read in blocks. Throws std::runtime_error if the snapshot is not valid for this key type, or if it is
+    // truncated, corrupted or its keys are not increasing; the set is left unchanged then.
+    void load(std::istream& in) {
+        // The size of a seekable stream bounds the key count of a damaged header.
+        uint64_t size = UINT64_MAX;
+        std::istream::pos_type start = in.tellg();
+        if (start != std::istream::pos_type(-1)) {
+            if (in.seekg(0, std::ios::end)) {
+                size = static_cast<uint64_t>(in.tellg() - start);
+            }
+            in.clear();
+            in.seekg(start);
         }
-        return 0;
+        Load([&in](char* data, size_t n) {
+            in.read(data, static_cast<std::streamsize>(n));
+            return static_cast<size_t>(in.gcount());
+        }, size);
     }
-    // Fixes height field of a vertex, if it is not correct.
-    void FixHeight(Node* v) {
-        if (v != nullptr) {
-            v->height = std::max(GetHeight(v->left_son), GetHeight(v->right_son)) + 1;
-        }
-    }
-    // Next two methods implement right and left_son rotation of a vertex to rebalance the tree. Complexity O(1).
-    Node* RightRotation(Node* v) {
-        Node* q = v->left_son;
-        v->left_son = q->right_son;
-        if (v->left_son != nullptr) {
-            v->left_son->parent = v;
-        }
-        q->right_son = v;
-        q->parent = v->parent;
-        v->parent = q;
-        FixHeight(v);
-        FixHeight(q);
-        return q;
-    }
-    Node* LeftRotation(Node* v) {
-        Node* q = v->right_son;
-        v->right_son = q->left_son;
-        if (v->right_son != nullptr) {
-            v->right_son->parent = v;
-        }
-        q->left_son = v;
-        q->parent = v->parent;
-        v->parent = q;
-        FixHeight(v);
-        FixHeight(q);
-        return q;
-    }
-    // Fixes the tree if the current vertex needs to be rebalanced. Complexity O(1).
-    Node* FixBalance(Node* v) {
-        if (v == nullptr) {
-            return nullptr;
+#ifdef SET_TEMPLATE_HAVE_FD_IO
+    // Writes the snapshot to the file descriptor, like save(std::ostream&).
+    void save(int fd) const {
+        Save([fd](const char* data, size_t n) {
+            while (n != 0) {
+                ssize_t written = ::write(fd, data, n);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    throw std::runtime_error("can not write the set snapshot");
+                }
+                data += written;
+                n -= static_cast<size_t>(written);
+            }
+        });
+    }
+    // Reads the snapshot from the file descriptor, like load(std::istream&).
+    void load(int fd) {
+        uint64_t size = UINT64_MAX;
+        struct stat st;
+        off_t start = ::lseek(fd, 0, SEEK_CUR);
+        if (start >= 0 && ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= start) {
+            size = static_cast<uint64_t>(st.st_size - start);
         }
-        FixHeight(v);
-        if (GetBalance(v) == -2) {
-            if (GetBalance(v->right_son) > 0) {
-                v->right_son = RightRotation(v->right_son);
+        Load([fd](char* data, size_t n) {
+            for (;;) {
+                ssize_t done = ::read(fd, data, n);
+                if (done >= 0) {
+                    return static_cast<size_t>(done);
+                }
+                if (errno != EINTR) {
+                    throw std::runtime_error("can not read the set snapshot");
+                }
+            }
+        }, size);
+    }
+#endif
+    // Returns the path taken by find(k): the visited vertices with their addresses and keys, and the comparisons.
+    // Runs the same search as find, but records it, so it is slower. Complexity O(log n).
+    SetExplanation<T> explain_find(const T& k) const {
+        SetExplanation<T> explanation;
+        const Hook* v = Tree::Find(root_, k, ExplainKeyOf{&explanation}, ExplainObserver{&explanation});
+        explanation.found = v != nullptr;
+        FinishExplanation(explanation, v);
+        return explanation;
+    }
+    // Returns the path taken by lower_bound(k), like explain_find. Complexity O(log n).
+    SetExplanation<T> explain_lower_bound(const T& k) const {
+        SetExplanation<T> explanation;
+        const Hook* v = Tree::LowerBound(root_, nullptr, k, ExplainKeyOf{&explanation}, ExplainObserver{&explanation});
+        explanation.found = !v->is_end;
+        FinishExplanation(explanation, v);
+        return explanation;
+    }
+    // Returns the access profile of the set: the top hottest keys, the hottest subtrees rooted at subtree_depth and
+    // the mean depths of the keys and of the accesses. Needs SetOptions::kAccessCounts. Complexity O(n log top).
+    SetAccessReport<T> access_report(size_t top = 10, size_t subtree_depth = 4) const {
+        static_assert(Options::kAccessCounts, "the set does not count accesses, use AccessCountingSetOptions");
+        using Report = SetAccessReport<T>;
+        Report report;
+        size_t depths = 0;
+        double weighted_depths = 0;
+        std::vector<std::pair<const Node*, uint32_t>> counts;
+        std::vector<typename Report::Subtree> subtrees;
+        // The walk keeps the index of the enclosing subtree, or size_t(-1) above subtree_depth.
+        struct Visit {
+            const Hook* v;
+            size_t depth;
+            size_t subtree;
+        };
+        std::vector<Visit> stack;
+        stack.push_back(Visit{root_, 0, size_t(-1)});
+        while (!stack.empty()) {
+            Visit visit = stack.back();
+            stack.pop_back();
+            const Node* n = visit.v->is_end ? nullptr : static_cast<const Node*>(visit.v);
+            // The end vertex holds no key, so its left son roots the subtree instead of it.
+            if (n != nullptr && visit.depth >= subtree_depth && visit.subtree == size_t(-1)) {
+                visit.subtree = subtrees.size();
+                subtrees.push_back(typename Report::Subtree{n->key, n->key, 0, 0});
+            }
+            for (const Hook* son : {visit.v->left_son, visit.v->right_son}) {
+                if (son != nullptr) {
+                    stack.push_back(Visit{son, visit.depth + 1, visit.subtree});
+                }
+            }
+            if (n == nullptr) {
+                continue;
+            }
+            uint32_t accesses = n->accesses.load(std::memory_order_relaxed);
+            depths += visit.depth;
+            if (accesses != 0) {
+                ++report.accessed_keys;
+                report.accesses += accesses;
+                report.saturated_keys += accesses == UINT32_MAX;
+                weighted_depths += static_cast<double>(visit.depth) * accesses;
+                counts.emplace_back(n, accesses);
+            }
+            if (visit.subtree != size_t(-1)) {
+                typename Report::Subtree& subtree = subtrees[visit.subtree];
+                if (n->key < subtree.min_key) {
+                    subtree.min_key = n->key;
+                }
+                if (subtree.max_key < n->key) {
+                    subtree.max_key = n->key;
+                }
+                ++subtree.keys;
+                subtree.accesses += accesses;
             }
-            v = LeftRotation(v);
-            return v;
         }
-        if (GetBalance(v) == 2) {
-            if (GetBalance(v->left_son) < 0) {
-                v->left_son = LeftRotation(v->left_son);
+        report.mean_depth = size_ == 0 ? 0.0 : static_cast<double>(depths) / size_;
+        if (report.accesses != 0) {
+            report.weighted_depth = weighted_depths / report.accesses;
+            for (const auto& count : counts) {
+                double p = static_cast<double>(count.second) / report.accesses;
+                report.entropy_bits -= p * std::log2(p);
             }
-            v = RightRotation(v);
-            return v;
         }
-        return v;
-    }
-    // Inserts a new element into the tree. Complexity O(log n).
-    Node* Insert(Node* v, const T& k, Node* parent) {
-        if (v == nullptr) {
-            return new Node(k, parent);
+        size_t hottest = std::min(top, counts.size());
+        std::partial_sort(counts.begin(), counts.begin() + hottest, counts.end(),
+                          [](const auto& a, const auto& b) { return a.second > b.second; });
+        for (size_t i = 0; i < hottest; ++i) {
+            report.hottest_keys.emplace_back(counts[i].first->key, counts[i].second);
         }
-        if (v->is_end || k < v->key) {
-            v->left_son = Insert(v->left_son, k, v);
-        } else {
-            v->right_son = Insert(v->right_son, k, v);
+        std::stable_sort(subtrees.begin(), subtrees.end(),
+                         [](const auto& a, const auto& b) { return a.accesses > b.accesses; });
+        subtrees.resize(std::min(top, subtrees.size()));
+        report.hottest_subtrees = std::move(subtrees);
+        return report;
+    }
+    // Resets the access counts of all the keys. Needs SetOptions::kAccessCounts. Complexity O(n).
+    void reset_access_counts() {
+        static_assert(Options::kAccessCounts, "the set does not count accesses, use AccessCountingSetOptions");
+        std::vector<Hook*> stack = {root_};
+        while (!stack.empty()) {
+            Hook* v = stack.back();
+            stack.pop_back();
+            if (!v->is_end) {
+                static_cast<Node*>(v)->accesses.store(0, std::memory_order_relaxed);
+            }
+            for (Hook* son : {v->left_son, v->right_son}) {
+                if (son != nullptr) {
+                    stack.push_back(son);
+                }
+            }
         }
-        v = FixBalance(v);
-        return v;
     }
-    // Finds minimal element in the subtree of a current vertex. Complexity O(log n).
-    Node* FindMin(Node* v) const {
-        if (v->left_son == nullptr) {
-            return v;
+    // Returns the operation counters of the set. Needs SetOptions::kCounters. The lookups update the counters with
+    // relaxed loads and stores, so they may run concurrently (under a shared lock), but then may lose counts; the
+    // counters read during updates are not a consistent snapshot.
+    SetCounters counters() const {
+        static_assert(Options::kCounters, "the set is not counting, use CountingSetOptions");
+        return this->counters_.Load();
+    }
+    // Resets the operation counters of the set. Needs SetOptions::kCounters.
+    void reset_counters() {
+        static_assert(Options::kCounters, "the set is not counting, use CountingSetOptions");
+        this->counters_.Reset();
+    }
+private:
+    // Returns the probe counting an operation into the given member of SetCounters and sampling it as sampled_op.
+    Probe MakeProbe(set_detail::RelaxedOperationCounters Counters::*op, SampledOp sampled_op) const {
+        if constexpr (Options::kCounters || Options::kSampling) {
+            return Probe(*this, op, sampled_op);
         } else {
-            return FindMin(v->left_son);
+            return Probe();
         }
     }
-    // Finds maximal element in the subtree of a current vertex. Complexity O(log n).
-    Node* FindEnd(Node* v) const {
-        if (v->right_son == nullptr) {
-            return v;
-        } else {
-            return FindEnd(v->right_son);
+    // Fills the result and the memory footprint of the path.
+    static void FinishExplanation(SetExplanation<T>& explanation, const Hook* result) {
+        if (result != nullptr && !result->is_end) {
+            explanation.result = KeyOfNode()(result);
+        }
+        std::vector<uintptr_t> lines;
+        std::vector<uintptr_t> pages;
+        for (const auto& step : explanation.path) {
+            auto address = reinterpret_cast<uintptr_t>(step.address);
+            // The end vertex is a bare hook inside the set.
+            size_t bytes = step.key ? sizeof(Node) : sizeof(Hook);
+            for (uintptr_t line = address / 64; line <= (address + bytes - 1) / 64; ++line) {
+                lines.push_back(line);
+            }
+            pages.push_back(address / 4096);
+        }
+        for (auto* v : {&lines, &pages}) {
+            std::sort(v->begin(), v->end());
+            v->erase(std::unique(v->begin(), v->end()), v->end());
         }
+        explanation.cache_lines = lines.size();
+        explanation.pages = pages.size();
     }
-    // Erases minimal element in the subtree of the current vertex. Complexity O(log n).
-    Node* EraseMin(Node* v) {
-        if (v->left_son == nullptr) {
-            if (v->right_son != nullptr) {
-                v->right_son->parent = v->parent;
+    // Counts an access to the vertex for access_report(), saturating at the counter maximum. The counter is
+    // incremented with a relaxed load and store, not an atomic addition: concurrent readers may lose counts, but
+    // do not race and do not contend on a locked instruction.
+    static void CountAccess(const Hook* v) {
+        if constexpr (Options::kAccessCounts) {
+            if (!v->is_end) {
+                std::atomic<uint32_t>& accesses = static_cast<const Node*>(v)->accesses;
+                uint32_t count = accesses.load(std::memory_order_relaxed);
+                if (count != UINT32_MAX) {
+                    accesses.store(count + 1, std::memory_order_relaxed);
+                }
             }
-            return v->right_son;
         }
-        v->left_son = EraseMin(v->left_son);
-        v = FixBalance(v);
+    }
+    // Allocates and constructs a tree vertex with the given constructor arguments.
+    template<typename... Args>
+    Node* NewNode(Args&&... args) {
+        Node* v = NodeAllocTraits::allocate(alloc_, 1);
+        try {
+            NodeAllocTraits::construct(alloc_, v, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeAllocTraits::deallocate(alloc_, v, 1);
+            throw;
+        }
+        if constexpr (Options::kCounters) {
+            this->counters_.allocations.Add(1);
+        }
         return v;
     }
-    // Erases vertex in the tree with the given key value or
-    // does nothing if such vertex does not exist. Complexity O(log n).
-    Node* Erase(Node* v, const T& k) {
+    // Destroys a tree vertex and returns its memory to the allocator.
+    void DeleteNode(Node* v) {
+        if constexpr (Options::kCounters) {
+            this->counters_.deallocations.Add(1);
+        }
+        NodeAllocTraits::destroy(alloc_, v);
+        NodeAllocTraits::deallocate(alloc_, v, 1);
+    }
+    // Returns true if the tree does not need to be destroyed vertex by vertex: vertex destructors are trivial
+    // and the allocator ignores deallocations, so the memory is released at once together with the memory resource.
+    bool SkipsTeardown() const {
+        return std::is_trivially_destructible<Node>::value && IgnoresDeallocation(alloc_);
+    }
+    template<class A>
+    static bool IgnoresDeallocation(const A&) {
+        return false;
+    }
+    template<class U>
+    static bool IgnoresDeallocation(const std::pmr::polymorphic_allocator<U>& alloc) {
+        return dynamic_cast<std::pmr::monotonic_buffer_resource*>(alloc.resource()) != nullptr;
+    }
+    // Next two pairs of methods forward reserve() and shrink_to_fit() to the allocator, if it provides them.
+    template<class A>
+    static auto ReserveNodes(A& alloc, size_t n, int) -> decltype(alloc.reserve(n), void()) {
+        alloc.reserve(n);
+    }
+    template<class A>
+    static void ReserveNodes(A&, size_t, long) {
+    }
+    template<class A>
+    static auto ShrinkNodes(A& alloc, int) -> decltype(alloc.shrink_to_fit(), void()) {
+        alloc.shrink_to_fit();
+    }
+    template<class A>
+    static void ShrinkNodes(A&, long) {
+    }
+    template<class Sink>
+    void Save(Sink sink) const {
+        SnapshotWriter out(std::move(sink));
+        SnapshotHeader header = MakeSnapshotHeader<T>(size_);
+        out.Write(&header, sizeof(header));
+        SaveKeys(out, root_);
+        out.Finish();
+    }
+    // Writes the keys of the subtree in order. The recursion depth is the tree height.
+    static void SaveKeys(SnapshotWriter& out, const Hook* v) {
         if (v == nullptr) {
-            return nullptr;
+            return;
         }
-        if (v->is_end || k < v->key) {
-            v->left_son = Erase(v->left_son, k);
-        } else if (v->key < k) {
-            v->right_son = Erase(v->right_son, k);
-        } else {
-            Node* l = v->left_son;
-            Node* r = v->right_son;
-            if (r == nullptr) {
-                if (l != nullptr) {
-                    l->parent = v->parent;
-                }
-                delete v;
-                return l;
-            }
-            Node* minnode = FindMin(r);
-            minnode->right_son = EraseMin(r);
-            minnode->parent = v->parent;
-            delete v;
-            minnode->left_son = l;
-            if (minnode->left_son != nullptr) {
-                minnode->left_son->parent = minnode;
-            }
-            if (minnode->right_son != nullptr) {
-                minnode->right_son->parent = minnode;
+        SaveKeys(out, v->left_son);
+        if (!v->is_end) {
+            SnapshotKeyCodec<T>::Write(out, KeyOfNode()(v));
+        }
+        SaveKeys(out, v->right_son);
+    }
+    // Destroys the vertices of the set, which is left empty.
+    void DestroyTree() noexcept {
+        if (!SkipsTeardown()) {
+            DestroySet(root_);
+        }
+        end_ = Tree::MakeEnd();
+        root_ = &end_;
+        size_ = 0;
+    }
+    // Replaces the vertices of the set with those of a set built for it with an equal allocator, which is left empty.
+    // The allocations made for the built set are counted to this one.
+    void ReplaceWith(Set& built) noexcept {
+        DestroyTree();
+        TakeTree(built);
+        if constexpr (Options::kCounters) {
+            this->counters_.allocations.Add(built.counters_.allocations.Load());
+        }
+    }
+    // Takes the vertices of the other set, whose nodes this allocator can free, into this empty set and leaves the
+    // other one empty. The end vertex is a member of the set, so it is relinked: in O(1) with parent links, in
+    // O(log n) without them.
+    void TakeTree(Set& st) noexcept {
+        if (st.size_ == 0) {
+            return;
+        }
+        end_ = st.end_;
+        size_ = st.size_;
+        // The end vertex is the greatest one, so it is the right son of its parent, found on the right spine.
+        Hook* parent = nullptr;
+        if constexpr (Options::kParentLinks) {
+            parent = st.end_.parent;
+        } else if (st.root_ != &st.end_) {
+            for (parent = st.root_; parent->right_son != &st.end_; parent = parent->right_son) {
             }
-            minnode = FixBalance(minnode);
-            return minnode;
         }
-        v = FixBalance(v);
-        return v;
+        if (parent == nullptr) {
+            root_ = &end_;
+        } else {
+            root_ = st.root_;
+            parent->right_son = &end_;
+        }
+        if (end_.left_son != nullptr) {
+            Tree::SetParent(end_.left_son, &end_);
+        }
+        st.end_ = Tree::MakeEnd();
+        st.root_ = &st.end_;
+        st.size_ = 0;
     }
-    // Finds a vertex with the given key value or returns nullptr if such vertex does not exist. Complexity O(log n).
-    Node* Find(Node* v, const T& k) const {
-        if (v == nullptr) {
-            return nullptr;
+    // Reads a snapshot of at most size bytes. The keys are loaded into a new set, which replaces the contents only
+    // after the checksum is verified, so a snapshot rejected for any reason leaves the set unchanged.
+    template<class Source>
+    void Load(Source source, uint64_t size) {
+        SnapshotReader in(std::move(source));
+        in.Limit(sizeof(SnapshotHeader));
+        SnapshotHeader header;
+        in.Read(&header, sizeof(header));
+        CheckSnapshotHeader<T>(header, size);
+        // The size of a snapshot of raw keys is known, the reader stops at its end. The header check keeps it from
+        // overflowing.
+        if (SnapshotKeyCodec<T>::kEncoding == SnapshotKeyEncoding::kRaw) {
+            in.Limit(header.count * sizeof(T) + sizeof(uint64_t));
+        } else {
+            in.Limit(UINT64_MAX);
         }
-        if (v->is_end) {
-            if (v->left_son != nullptr && !(v->left_son->key < k) && !(k < v->left_son->key)) {
-                return v->left_son;
+        // The new set frees its vertices if reading throws.
+        Set loaded(alloc_);
+        SnapshotKeys keys(in, header.count);
+        uint64_t position = 0;
+        const Node* previous = nullptr;
+        // The header check keeps count + 1 from wrapping, so the tree always holds at least the end vertex.
+        loaded.root_ = loaded.LoadBalanced(keys, header.count + 1, header.count, position, previous);
+        Tree::SetParent(loaded.root_, nullptr);
+        loaded.size_ = header.count;
+        if (!in.Verify()) {
+            throw std::runtime_error("set snapshot checksum mismatch");
+        }
+        ReplaceWith(loaded);
+    }
+    // Reads the keys of a snapshot in order. Raw keys are read in blocks of 64 KiB, a single read each, the others
+    // one by one through their codec.
+    class SnapshotKeys {
+    public:
+        SnapshotKeys(SnapshotReader& in, uint64_t count) : in_(in), left_(count) {
+        }
+        T Next() {
+            if constexpr (SnapshotKeyCodec<T>::kEncoding == SnapshotKeyEncoding::kRaw) {
+                if (next_ == block_.size()) {
+                    block_.resize(static_cast<size_t>(std::min<uint64_t>(left_, kBlockKeys)));
+                    in_.Read(block_.data(), block_.size() * sizeof(T));
+                    next_ = 0;
+                }
+                --left_;
+                return block_[next_++];
             } else {
-                return nullptr;
+                return SnapshotKeyCodec<T>::Read(in_);
             }
         }
-        if (k < v->key) {
-            return Find(v->left_son, k);
-        } else if (v->key < k) {
-            return Find(v->right_son, k);
-        }
-        return v;
+    private:
+        static constexpr size_t kBlockKeys = std::max<size_t>(1, 64 * 1024 / sizeof(T));
 
-    }
-    // Finds a vertex with the minimal value more or equal to the given key value. Complexity O(log n).
-    Node* LowerBound(Node* v, Node* par, const T& k) const {
-        if (v == nullptr) {
-            return par;
+        SnapshotReader& in_;
+        uint64_t left_;
+        std::vector<T> block_;
+        size_t next_ = 0;
+    };
+    // Builds a balanced tree of the next count vertices in increasing order, taking their keys from the snapshot;
+    // the vertex at position n is the end vertex. Sibling subtrees differ in size by at most one, so their heights
+    // differ by at most one too. Frees the vertices of the subtree if reading throws.
+    Hook* LoadBalanced(SnapshotKeys& keys, uint64_t count, uint64_t n, uint64_t& position, const Node*& previous) {
+        if (count == 0) {
+            return nullptr;
         }
-        if (v->is_end) {
-            if (v->left_son != nullptr && !(v->left_son->key < k)) {
-                return v->left_son;
+        uint64_t left_count = (count - 1) / 2;
+        Hook* l = LoadBalanced(keys, left_count, n, position, previous);
+        Hook* v = &end_;
+        Hook* r = nullptr;
+        try {
+            if (position != n) {
+                Node* node = NewNode(keys.Next());
+                v = node;
+                if (previous != nullptr && !(previous->key < node->key)) {
+                    throw std::runtime_error("set snapshot keys are not increasing");
+                }
+                previous = node;
             }
-            return v;
+            ++position;
+            r = LoadBalanced(keys, count - 1 - left_count, n, position, previous);
+        } catch (...) {
+            DestroySet(l);
+            if (v != &end_) {
+                DeleteNode(static_cast<Node*>(v));
+            }
+            throw;
         }
-        if (k < v->key) {
-            return LowerBound(v->left_son, v, k);
-        } else if (v->key < k) {
-            return LowerBound(v->right_son, v, k);
+        v->left_son = l;
+        v->right_son = r;
+        for (Hook* son : {l, r}) {
+            if (son != nullptr) {
+                Tree::SetParent(son, v);
+            }
         }
+        Tree::FixHeight(v);
         return v;
     }
-    // Deallocates the memory of the whole tree.
-    void DestroySet(Node* v) {
+    // Inserts the keys in a constructor. The destructor does not run for a constructor which throws, so the vertices
+    // inserted before the exception are freed here.
+    template<typename Iterator>
+    void InsertOrDestroy(Iterator beginit, Iterator endit) {
+        try {
+            std::for_each(beginit, endit, [this](const T& k) { (*this).insert(k); });
+        } catch (...) {
+            DestroySet(root_);
+            throw;
+        }
+    }
+    // Deallocates the memory of the whole tree. The recursion depth is the tree height, which is at most
+    // SetStats::HeightBound(size_): 43 for 1e9 keys.
+    void DestroySet(Hook* v) {
         if (v == nullptr) {
             return;
         }
         DestroySet(v->left_son);
         DestroySet(v->right_son);
-        delete v;
+        if (!v->is_end) {
+            DeleteNode(static_cast<Node*>(v));
+        }
     }
-    // Creates a deep copy of a given tree.
-    Node* CopyNode(Node* v, Node* par) {
+    // Creates a deep copy of a given tree, the end vertex of the copy is the end vertex of this set. If an allocation
+    // throws, the vertices copied so far are freed.
+    Hook* CopyNode(const Hook* v, Hook* par) {
         if (v == nullptr) {
             return nullptr;
         }
         if (v->is_end) {
-            Node* n = new Node(par);
+            Tree::SetParent(&end_, par);
+            end_.height = v->height;
+            end_.left_son = CopyNode(v->left_son, &end_);
+            return &end_;
+        }
+        Node* n = NewNode(KeyOfNode()(v));
+        Tree::SetParent(n, par);
+        n->height = v->height;
+        try {
             n->left_son = CopyNode(v->left_son, n);
-            return n;
+            n->right_son = CopyNode(v->right_son, n);
+        } catch (...) {
+            DestroySet(n);
+            throw;
         }
-        Node* n = new Node(v->key, par);
-        n->left_son = CopyNode(v->left_son, n);
-        n->right_son = CopyNode(v->right_son, n);
         return n;
     }
 private:
-    Node* root_ = nullptr;
+    Hook end_ = Tree::MakeEnd();
+    Hook* root_ = &end_;
     size_t size_ = 0;
-    Node* end_ = nullptr;
+    NodeAlloc alloc_;
 };
+
+namespace pmr {
+
+// Set which allocates its vertices from a std::pmr::memory_resource. Sets using a std::pmr::monotonic_buffer_resource
+// with trivially destructible keys skip the vertex-by-vertex teardown in the destructor, the memory is released
+// together with the resource. Following the std::pmr containers, a copy uses the default memory resource unless
+// a different allocator is given to the copy constructor.
+template<class T, class Options = SetOptions>
+using Set = ::Set<T, std::pmr::polymorphic_allocator<T>, Options>;
+
+}  // namespace pmr
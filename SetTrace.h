@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "SetTemplate.h"
+
+// Recording of set operations into a compact binary trace, for replaying production workloads in benchmarks
+// (bench/SetReplay.cpp) without shipping the data around.
+//
+// Format: a 16-byte header (magic "SETTRACE", format version, key encoding, key size), then one record per operation:
+// the operation byte followed by the key. Integral keys are zigzag LEB128 varints, strings are a varint length and
+// the bytes, other trivially copyable keys are copied as is.
+//
+// Usage:
+//     std::ofstream out("sets.trace", std::ios::binary);
+//     TraceWriter<int64_t> writer(out);
+//     TracedSet<int64_t> s(&writer);  // Same interface as Set<int64_t>, every insert, erase, find and lower_bound
+//                                     // is recorded; with a null writer nothing is recorded.
+
+enum class SetOp : uint8_t {
+    kInsert = 0,
+    kErase = 1,
+    kFind = 2,
+    kLowerBound = 3,
+};
+
+enum class TraceKeyKind : uint8_t {
+    kInteger = 0,
+    kString = 1,
+    kRaw = 2,
+};
+
+// One operation of a trace.
+template<class T>
+struct TraceRecord {
+    SetOp op;
+    T key;
+};
+
+// Encoding of the keys of type T in a trace.
+template<class T, class Enable = void>
+struct TraceKeyCodec {
+    static_assert(std::is_trivially_copyable<T>::value, "TraceKeyCodec is not defined for this key type");
+    static constexpr TraceKeyKind kKind = TraceKeyKind::kRaw;
+
+    static void Write(std::ostream& out, const T& k) {
+        out.write(reinterpret_cast<const char*>(&k), sizeof(T));
+    }
+    static bool Read(std::istream& in, T& k) {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&k), sizeof(T)));
+    }
+};
+
+namespace trace_detail {
+
+inline void WriteVarint(std::ostream& out, uint64_t x) {
+    char buf[10];
+    size_t n = 0;
+    while (x >= 0x80) {
+        buf[n++] = static_cast<char>(x | 0x80);
+        x >>= 7;
+    }
+    buf[n++] = static_cast<char>(x);
+    out.write(buf, n);
+}
+
+inline bool ReadVarint(std::istream& in, uint64_t& x) {
+    x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == std::char_traits<char>::eof()) {
+            return false;
+        }
+        x |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace trace_detail
+
+template<class T>
+struct TraceKeyCodec<T, std::enable_if_t<std::is_integral<T>::value>> {
+    static constexpr TraceKeyKind kKind = TraceKeyKind::kInteger;
+
+    // Signed keys are zigzag encoded, so that small negative keys are short too.
+    static void Write(std::ostream& out, T k) {
+        uint64_t x = static_cast<uint64_t>(k);
+        if (std::is_signed<T>::value) {
+            x = (x << 1) ^ (k < 0 ? ~uint64_t(0) : 0);
+        }
+        trace_detail::WriteVarint(out, x);
+    }
+    static bool Read(std::istream& in, T& k) {
+        uint64_t x;
+        if (!trace_detail::ReadVarint(in, x)) {
+            return false;
+        }
+        if (std::is_signed<T>::value) {
+            x = (x >> 1) ^ (~(x & 1) + 1);
+        }
+        k = static_cast<T>(x);
+        return true;
+    }
+};
+
+template<>
+struct TraceKeyCodec<std::string> {
+    static constexpr TraceKeyKind kKind = TraceKeyKind::kString;
+
+    static void Write(std::ostream& out, const std::string& k) {
+        trace_detail::WriteVarint(out, k.size());
+        out.write(k.data(), k.size());
+    }
+    static bool Read(std::istream& in, std::string& k) {
+        uint64_t size;
+        if (!trace_detail::ReadVarint(in, size)) {
+            return false;
+        }
+        // A corrupted length fails as a truncated trace before allocating all of it.
+        k.clear();
+        while (k.size() < size) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(size - k.size(), 1 << 20));
+            size_t old_size = k.size();
+            k.resize(old_size + chunk);
+            if (!in.read(&k[old_size], static_cast<std::streamsize>(chunk))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Header of a trace file.
+struct TraceHeader {
+    static constexpr char kMagic[8] = {'S', 'E', 'T', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr uint32_t kVersion = 1;
+
+    char magic[8];
+    uint32_t version;
+    TraceKeyKind key_kind;
+    uint8_t key_size;  // sizeof of the key type, which TraceWriter and TraceReader limit to 255.
+    uint8_t reserved[2];
+};
+static_assert(sizeof(TraceHeader) == 16, "TraceHeader must be 16 bytes");
+
+// Reads the header of a trace, throws std::runtime_error if the stream does not start with a valid header.
+inline TraceHeader ReadTraceHeader(std::istream& in) {
+    TraceHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, TraceHeader::kMagic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("not a set trace");
+    }
+    if (header.version != TraceHeader::kVersion) {
+        throw std::runtime_error("unsupported set trace version");
+    }
+    return header;
+}
+
+// Writes the header on construction and then one record per Write call.
+template<class T>
+class TraceWriter {
+    static_assert(sizeof(T) <= UINT8_MAX, "the trace header stores the key size in a byte");
+public:
+    explicit TraceWriter(std::ostream& out) : out_(out) {
+        TraceHeader header{};
+        std::memcpy(header.magic, TraceHeader::kMagic, sizeof(header.magic));
+        header.version = TraceHeader::kVersion;
+        header.key_kind = TraceKeyCodec<T>::kKind;
+        header.key_size = static_cast<uint8_t>(sizeof(T));
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    void Write(SetOp op, const T& k) {
+        out_.put(static_cast<char>(op));
+        TraceKeyCodec<T>::Write(out_, k);
+        ++records_;
+    }
+    // Returns the number of records written.
+    size_t records() const {
+        return records_;
+    }
+private:
+    std::ostream& out_;
+    size_t records_ = 0;
+};
+
+// Reads the records of a trace, checking on construction that the header matches the key type.
+template<class T>
+class TraceReader {
+    static_assert(sizeof(T) <= UINT8_MAX, "the trace header stores the key size in a byte");
+public:
+    explicit TraceReader(std::istream& in) : in_(in) {
+        TraceHeader header = ReadTraceHeader(in_);
+        if (header.key_kind != TraceKeyCodec<T>::kKind || header.key_size != sizeof(T)) {
+            throw std::runtime_error("set trace key type mismatch");
+        }
+    }
+    // Reads the next record, returns false at the end of the trace.
+    bool Read(TraceRecord<T>& record) {
+        int op = in_.get();
+        if (op == std::char_traits<char>::eof()) {
+            return false;
+        }
+        record.op = static_cast<SetOp>(op);
+        return TraceKeyCodec<T>::Read(in_, record.key);
+    }
+private:
+    std::istream& in_;
+};
+
+// Set wrapper, which records insert, erase, find and lower_bound calls into the given writer (if it is not null)
+// and forwards them to the wrapped set S.
+template<class T, class S = Set<T>>
+class TracedSet {
+public:
+    using iterator = typename S::iterator;
+
+    explicit TracedSet(TraceWriter<T>* writer = nullptr) : writer_(writer) {
+    }
+    // Starts or stops recording.
+    void set_writer(TraceWriter<T>* writer) {
+        writer_ = writer;
+    }
+    void insert(const T& k) {
+        Record(SetOp::kInsert, k);
+        set_.insert(k);
+    }
+    void erase(const T& k) {
+        Record(SetOp::kErase, k);
+        set_.erase(k);
+    }
+    iterator find(const T& k) const {
+        Record(SetOp::kFind, k);
+        return set_.find(k);
+    }
+    iterator lower_bound(const T& k) const {
+        Record(SetOp::kLowerBound, k);
+        return set_.lower_bound(k);
+    }
+    size_t size() const {
+        return set_.size();
+    }
+    bool empty() const {
+        return set_.empty();
+    }
+    iterator begin() const {
+        return set_.begin();
+    }
+    iterator end() const {
+        return set_.end();
+    }
+    // Returns the wrapped set.
+    const S& set() const {
+        return set_;
+    }
+private:
+    void Record(SetOp op, const T& k) const {
+        if (writer_ != nullptr) {
+            writer_->Write(op, k);
+        }
+    }
+private:
+    S set_;
+    TraceWriter<T>* writer_;
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "SetTemplate.h"
+
+// Set with inline storage for small sizes. Up to N keys are kept in a sorted array inside the set object itself,
+// with no heap allocation at all. Inserting the (N + 1)-th key promotes the set to the AVL-tree representation
+// (Set<T, Allocator>), the set stays a tree afterwards.
+// Supports the same methods as Set, iterators are invalidated by the promotion.
+
+template<class T, size_t N = 8, class Allocator = NodeAllocator<T>>
+class SmallSet {
+private:
+    using Tree = Set<T, Allocator>;
+public:
+    // Iterator class for the set. Walks the inline array in the small representation and the tree otherwise.
+    class iterator {
+    public:
+        iterator() = default;
+        explicit iterator(const T* v) : ptr_(v) {}
+        explicit iterator(typename Tree::iterator it) : it_(it) {}
+        bool operator==(const iterator& iter) const {
+            return ptr_ == iter.ptr_ && (ptr_ != nullptr || it_ == iter.it_);
+        }
+        bool operator!=(const iterator& iter) const {
+            return !(*this == iter);
+        }
+        // Incrementing past-the-last element iterator or decrementing first element iterator causes undefined behaviour.
+        iterator& operator++() {
+            if (ptr_ != nullptr) {
+                ++ptr_;
+            } else {
+                ++it_;
+            }
+            return *this;
+        }
+        iterator& operator--() {
+            if (ptr_ != nullptr) {
+                --ptr_;
+            } else {
+                --it_;
+            }
+            return *this;
+        }
+        T operator*() const {
+            if (ptr_ != nullptr) {
+                return *ptr_;
+            }
+            return *it_;
+        }
+        const T* operator->() const {
+            if (ptr_ != nullptr) {
+                return ptr_;
+            }
+            return it_.operator->();
+        }
+    private:
+        const T* ptr_ = nullptr;
+        typename Tree::iterator it_{};
+    };
+    // Default set constructor, does not allocate.
+    SmallSet() {
+        new (&keys_) std::array<T, N>();
+    }
+    // Constructor from the given sequence of elements specified by the begin and end iterators.
+    template<typename Iterator>
+    SmallSet(Iterator beginit, Iterator endit) : SmallSet() {
+        std::for_each(beginit, endit, [this](const T& k) { (*this).insert(k); });
+    }
+    // Initializer list constructor.
+    SmallSet(std::initializer_list<T> lst) : SmallSet(lst.begin(), lst.end()) {
+    }
+    // Copy constructor.
+    SmallSet(const SmallSet& st) {
+        Construct(st);
+    }
+    // Move constructor. Takes the tree of a large set or moves the inline keys of a small one; the other set is left
+    // empty, in the same representation.
+    SmallSet(SmallSet&& st) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        Construct(std::move(st));
+    }
+    // Copy assignment operator. The copy is made before the old keys are destroyed, so if it throws the set is not
+    // changed (as long as moving T does not throw).
+    SmallSet& operator=(const SmallSet& st) {
+        if (this == &st) {
+            return *this;
+        }
+        if (st.large_) {
+            Tree tree(st.tree_);
+            Destroy();
+            new (&tree_) Tree(std::move(tree));
+        } else {
+            std::array<T, N> keys(st.keys_);
+            Destroy();
+            new (&keys_) std::array<T, N>(std::move(keys));
+        }
+        large_ = st.large_;
+        size_ = st.size_;
+        return *this;
+    }
+    // Move assignment operator. Like the copy assignment, the keys are moved out of the other set before the old
+    // ones are destroyed.
+    SmallSet& operator=(SmallSet&& st) noexcept(std::is_nothrow_move_constructible<T>::value) {
+        if (this == &st) {
+            return *this;
+        }
+        if (st.large_) {
+            Tree tree(std::move(st.tree_));
+            Destroy();
+            new (&tree_) Tree(std::move(tree));
+        } else {
+            std::array<T, N> keys(std::move(st.keys_));
+            Destroy();
+            new (&keys_) std::array<T, N>(std::move(keys));
+        }
+        large_ = st.large_;
+        size_ = st.size_;
+        st.size_ = 0;
+        return *this;
+    }
+    ~SmallSet() {
+        Destroy();
+    }
+    // Returns the number of elements in the set.
+    size_t size() const {
+        if (large_) {
+            return tree_.size();
+        }
+        return size_;
+    }
+    // Returns true if the set is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+    // Returns true if the keys are kept in the AVL-tree.
+    bool is_large() const {
+        return large_;
+    }
+    // Inserts element with the given value to the set. Complexity O(N) in the small representation,
+    // O(log n) in the tree.
+    void insert(const T& k) {
+        if (large_) {
+            tree_.insert(k);
+            return;
+        }
+        T* pos = LowerBound(k);
+        if (pos != keys_.data() + size_ && !(k < *pos)) {
+            return;
+        }
+        if (size_ == N) {
+            Promote(k);
+            return;
+        }
+        std::move_backward(pos, keys_.data() + size_, keys_.data() + size_ + 1);
+        *pos = k;
+        ++size_;
+    }
+    // Erases an element with the given key or does nothing if no such element is found.
+    void erase(const T& k) {
+        if (large_) {
+            tree_.erase(k);
+            return;
+        }
+        T* pos = LowerBound(k);
+        if (pos == keys_.data() + size_ || k < *pos) {
+            return;
+        }
+        std::move(pos + 1, keys_.data() + size_, pos);
+        --size_;
+        keys_[size_] = T();
+    }
+    // Returns an iterator to the element with the given key or past-the-end iterator if no such element is found.
+    iterator find(const T& k) const {
+        if (large_) {
+            return iterator(tree_.find(k));
+        }
+        const T* pos = LowerBound(k);
+        if (pos == keys_.data() + size_ || k < *pos) {
+            return end();
+        }
+        return iterator(pos);
+    }
+    // Returns iterator to the first element with the value more or equal to the given key.
+    iterator lower_bound(const T& k) const {
+        if (large_) {
+            return iterator(tree_.lower_bound(k));
+        }
+        return iterator(LowerBound(k));
+    }
+    // Returns iterator to the first element.
+    iterator begin() const {
+        if (large_) {
+            return iterator(tree_.begin());
+        }
+        return iterator(keys_.data());
+    }
+    // Return past-the-end iterator.
+    iterator end() const {
+        if (large_) {
+            return iterator(tree_.end());
+        }
+        return iterator(keys_.data() + size_);
+    }
+private:
+    T* LowerBound(const T& k) {
+        return std::lower_bound(keys_.data(), keys_.data() + size_, k);
+    }
+    const T* LowerBound(const T& k) const {
+        return std::lower_bound(keys_.data(), keys_.data() + size_, k);
+    }
+    // Copies the inline keys and the new key k into a new tree, which then takes the place of the array. If building
+    // the tree throws, the set keeps its keys in the array.
+    void Promote(const T& k) {
+        Tree tree(keys_.data(), keys_.data() + size_);
+        tree.insert(k);
+        keys_.~array();
+        new (&tree_) Tree(std::move(tree));
+        large_ = true;
+    }
+    void Construct(const SmallSet& st) {
+        if (st.large_) {
+            new (&tree_) Tree(st.tree_);
+        } else {
+            new (&keys_) std::array<T, N>(st.keys_);
+        }
+        large_ = st.large_;
+        size_ = st.size_;
+    }
+    void Construct(SmallSet&& st) {
+        if (st.large_) {
+            new (&tree_) Tree(std::move(st.tree_));
+        } else {
+            new (&keys_) std::array<T, N>(std::move(st.keys_));
+        }
+        large_ = st.large_;
+        size_ = st.size_;
+        st.size_ = 0;
+    }
+    void Destroy() {
+        if (large_) {
+            tree_.~Tree();
+        } else {
+            keys_.~array();
+        }
+    }
+private:
+    union {
+        std::array<T, N> keys_;
+        Tree tree_;
+    };
+    size_t size_ = 0;
+    bool large_ = false;
+};
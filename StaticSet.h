@@ -0,0 +1,243 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#include "AvlTree.h"
+
+// Fixed-capacity set based on AVL-tree, which never allocates. All the vertices live in an array inside the set
+// object and are linked by relative offsets (AvlRelativeHook) instead of pointers, so operations take deterministic
+// time without any allocator calls and may be used in signal handlers (as long as copying and comparing T is).
+// The balancing is the one of AvlTree.h, the offsets are 2 bytes for small sets. insert() reports overflow through
+// its return value. Supports the same methods as Set.
+
+// Result of StaticSet::insert.
+enum class InsertResult : uint8_t {
+    kInserted,
+    kExists,  // The key is already in the set.
+    kFull,    // The key is not in the set, which holds Capacity keys.
+};
+
+template<class T, size_t Capacity>
+class StaticSet {
+private:
+    using Index = std::conditional_t<Capacity < UINT16_MAX, uint16_t, uint32_t>;
+    static constexpr Index kNil = std::numeric_limits<Index>::max();
+    static_assert(Capacity < kNil, "Capacity is too large");
+    // A vertex takes at most sizeof(T) + alignof(T) + 8 bytes with 2-byte offsets.
+    using Offset = std::conditional_t<(Capacity + 1) * (sizeof(T) + alignof(T) + 8) <= INT16_MAX, int16_t, int32_t>;
+    using Hook = AvlRelativeHook<Offset>;
+    using Tree = AvlTree<Hook>;
+
+    // Slot 0 holds the end vertex, slots 1..Capacity hold the keys. A slot with zero height is free, free slots are
+    // linked through right_son.
+    struct Node : Hook {
+        union {
+            T key;
+        };
+        Node() {}
+        ~Node() {}
+    };
+    static_assert((Capacity + 1) * sizeof(Node) <= static_cast<size_t>(std::numeric_limits<Offset>::max()),
+                  "Capacity is too large");
+    // Maps a tree vertex, which is not the end vertex, to its key.
+    struct KeyOfNode {
+        const T& operator()(const Hook* v) const {
+            return static_cast<const Node*>(v)->key;
+        }
+    };
+public:
+    // Iterator class for the set, using pointer to const tree vertex to operate.
+    // Supports the similar methods as the STL set iterator.
+    class iterator {
+    public:
+        iterator() = default;
+        explicit iterator(const Hook* v) : v_(v) {}
+        bool operator==(const iterator& iter) const {
+            return v_ == iter.v_;
+        }
+        bool operator!=(const iterator& iter) const {
+            return v_ != iter.v_;
+        }
+        // Incrementing past-the-last element iterator or decrementing first element iterator causes undefined behaviour.
+        iterator& operator++() {
+            v_ = Tree::Next(v_);
+            return *this;
+        }
+        iterator& operator--() {
+            v_ = Tree::Prev(v_);
+            return *this;
+        }
+        const T& operator*() const {
+            return KeyOfNode()(v_);
+        }
+        const T* operator->() const {
+            return &KeyOfNode()(v_);
+        }
+    private:
+        const Hook* v_ = nullptr;
+    };
+    // Default set constructor. Complexity O(1), the vertex array is not touched.
+    StaticSet() {
+        Reset();
+    }
+    // Copy constructor.
+    StaticSet(const StaticSet& st) {
+        CopyFrom(st);
+    }
+    // Copy assignment operator. If copying a key throws, the set is left empty.
+    StaticSet& operator=(const StaticSet& st) {
+        if (this == &st) {
+            return *this;
+        }
+        DestroyKeys();
+        Reset();
+        CopyFrom(st);
+        return *this;
+    }
+    ~StaticSet() {
+        DestroyKeys();
+    }
+    // Returns the number of elements in the set.
+    size_t size() const {
+        return size_;
+    }
+    // Returns true if the set is empty.
+    bool empty() const {
+        return size_ == 0;
+    }
+    // Returns the maximal number of elements in the set.
+    static constexpr size_t capacity() {
+        return Capacity;
+    }
+    // Inserts element with the given value to the set. The set is not changed, unless the result is kInserted.
+    // Complexity O(log n).
+    [[nodiscard]] InsertResult insert(const T& k) {
+        if (Tree::Find(Root(), k, KeyOfNode()) != nullptr) {
+            return InsertResult::kExists;
+        }
+        if (size_ == Capacity) {
+            return InsertResult::kFull;
+        }
+        Index n = free_ != kNil ? free_ : used_slots_;
+        new (&nodes_[n].key) T(k);
+        if (n == free_) {
+            free_ = IndexOf(nodes_[n].right_son);
+        } else {
+            ++used_slots_;
+        }
+        ++size_;
+        nodes_[n].is_end = false;
+        root_ = IndexOf(Tree::Insert(Root(), &nodes_[n], nullptr, k, KeyOfNode()));
+        return InsertResult::kInserted;
+    }
+    // Erases an element with the given key or does nothing if no such element is found. Complexity O(log n).
+    void erase(const T& k) {
+        Hook* v = nullptr;
+        root_ = IndexOf(Tree::Erase(Root(), nullptr, k, KeyOfNode(), v));
+        if (v == nullptr) {
+            return;
+        }
+        --size_;
+        Node* n = static_cast<Node*>(v);
+        n->key.~T();
+        n->height = 0;
+        n->right_son = free_ != kNil ? &nodes_[free_] : nullptr;
+        free_ = IndexOf(n);
+    }
+    // Returns an iterator to the element with the given key or past-the-end iterator if no such element is found.
+    // Complexity O(log n).
+    iterator find(const T& k) const {
+        const Hook* v = Tree::Find(Root(), k, KeyOfNode());
+        if (v == nullptr) {
+            return end();
+        }
+        return iterator(v);
+    }
+    // Returns iterator to the first element with the value more or equal to the given key. Complexity O(log n).
+    iterator lower_bound(const T& k) const {
+        return iterator(Tree::LowerBound(Root(), nullptr, k, KeyOfNode()));
+    }
+    // Returns iterator to the first element.
+    iterator begin() const {
+        return iterator(Tree::FindMin(static_cast<const Hook*>(Root())));
+    }
+    // Return past-the-end iterator.
+    iterator end() const {
+        return iterator(&nodes_[0]);
+    }
+private:
+    Hook* Root() const {
+        return const_cast<Node*>(&nodes_[root_]);
+    }
+    Index IndexOf(const Hook* v) const {
+        return v == nullptr ? kNil : static_cast<Index>(static_cast<const Node*>(v) - nodes_.data());
+    }
+    // Makes the set empty, without destroying the keys.
+    void Reset() {
+        Node& end = nodes_[0];
+        end.left_son = nullptr;
+        end.right_son = nullptr;
+        end.parent = nullptr;
+        end.height = 1;
+        end.is_end = true;
+        root_ = 0;
+        size_ = 0;
+        free_ = kNil;
+        used_slots_ = 1;
+    }
+    // Copies the set into this one, which holds no keys. The links are relative, so the vertices are copied with their
+    // links as they are into the same slots. The keys are copied first: if a copy throws, the copied keys are
+    // destroyed and the set is left empty.
+    void CopyFrom(const StaticSet& st) {
+        Index v = 1;
+        try {
+            for (; v < st.used_slots_; ++v) {
+                if (st.nodes_[v].height != 0) {
+                    new (&nodes_[v].key) T(st.nodes_[v].key);
+                }
+            }
+        } catch (...) {
+            while (--v > 0) {
+                if (st.nodes_[v].height != 0) {
+                    nodes_[v].key.~T();
+                }
+            }
+            Reset();
+            throw;
+        }
+        for (v = 0; v < st.used_slots_; ++v) {
+            const Node& from = st.nodes_[v];
+            Node& to = nodes_[v];
+            to.left_son.CopyRaw(from.left_son);
+            to.right_son.CopyRaw(from.right_son);
+            to.parent.CopyRaw(from.parent);
+            to.height = from.height;
+            to.is_end = from.is_end;
+        }
+        root_ = st.root_;
+        size_ = st.size_;
+        free_ = st.free_;
+        used_slots_ = st.used_slots_;
+    }
+    void DestroyKeys() {
+        if (std::is_trivially_destructible<T>::value) {
+            return;
+        }
+        for (Index v = 1; v < used_slots_; ++v) {
+            if (nodes_[v].height != 0) {
+                nodes_[v].key.~T();
+            }
+        }
+    }
+private:
+    std::array<Node, Capacity + 1> nodes_;
+    Index root_ = 0;
+    Index size_ = 0;
+    Index free_ = kNil;
+    Index used_slots_ = 1;
+};
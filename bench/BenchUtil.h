@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Key types, access orders and the sorted vector baseline shared by the benchmarks.
+
+namespace bench {
+
+// 64-byte key with a 64-bit identifier, the rest is payload.
+struct Pod64 {
+    uint64_t id;
+    char payload[56];
+    bool operator<(const Pod64& o) const {
+        return id < o.id;
+    }
+    bool operator==(const Pod64& o) const {
+        return id == o.id;
+    }
+};
+
+// Maps i to a key of type K, preserving the order of i.
+template<class K>
+K MakeKey(uint64_t i);
+
+template<>
+inline int32_t MakeKey<int32_t>(uint64_t i) {
+    return static_cast<int32_t>(i);
+}
+template<>
+inline int64_t MakeKey<int64_t>(uint64_t i) {
+    return static_cast<int64_t>(i);
+}
+template<>
+inline std::string MakeKey<std::string>(uint64_t i) {
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "key%016llu", static_cast<unsigned long long>(i));
+    return buf;
+}
+template<>
+inline Pod64 MakeKey<Pod64>(uint64_t i) {
+    Pod64 k;
+    k.id = i;
+    std::memset(k.payload, static_cast<int>(i), sizeof(k.payload));
+    return k;
+}
+
+template<class K>
+const char* KeyName();
+template<>
+inline const char* KeyName<int32_t>() {
+    return "int32";
+}
+template<>
+inline const char* KeyName<int64_t>() {
+    return "int64";
+}
+template<>
+inline const char* KeyName<std::string>() {
+    return "string";
+}
+template<>
+inline const char* KeyName<Pod64>() {
+    return "pod64";
+}
+
+// Scatters the ranks of a skewed distribution over the key space, so hot keys are not neighbours (FNV-1a).
+inline uint64_t Scramble(uint64_t x) {
+    uint64_t h = 14695981039346656037ull;
+    for (int i = 0; i < 8; ++i) {
+        h ^= (x >> (8 * i)) & 0xff;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Zipfian distribution over [0, n), rank 0 is the most popular one. Gray et al., "Quickly generating
+// billion-record synthetic databases", the generator used by YCSB. Construction takes O(n).
+class ZipfGenerator {
+public:
+    explicit ZipfGenerator(uint64_t n, double theta = 0.99) : n_(n), theta_(theta) {
+        zetan_ = Zeta(n_, theta_);
+        double zeta2 = Zeta(2, theta_);
+        alpha_ = 1.0 / (1.0 - theta_);
+        eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) / (1.0 - zeta2 / zetan_);
+    }
+    template<class Rng>
+    uint64_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta_)) {
+            return 1;
+        }
+        uint64_t r = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return std::min(r, n_ - 1);
+    }
+private:
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        return sum;
+    }
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+enum class Order {
+    kSequential,
+    kUniform,
+    kZipfian,
+};
+
+inline const char* OrderName(Order order) {
+    switch (order) {
+        case Order::kSequential:
+            return "seq";
+        case Order::kUniform:
+            return "uniform";
+        case Order::kZipfian:
+            return "zipf";
+    }
+    return "";
+}
+
+// Returns count indices in [0, n) in the given order. Sequential and uniform orders of n indices are permutations,
+// so every index is visited once; zipfian indices repeat.
+inline std::vector<uint64_t> MakeOrder(Order order, uint64_t n, uint64_t count, uint64_t seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> result(count);
+    switch (order) {
+        case Order::kSequential:
+            for (uint64_t i = 0; i < count; ++i) {
+                result[i] = i % n;
+            }
+            break;
+        case Order::kUniform:
+            for (uint64_t i = 0; i < count; ++i) {
+                result[i] = i % n;
+            }
+            std::shuffle(result.begin(), result.end(), rng);
+            break;
+        case Order::kZipfian: {
+            ZipfGenerator zipf(n);
+            for (uint64_t i = 0; i < count; ++i) {
+                result[i] = Scramble(zipf(rng)) % n;
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+// Sorted vector with the Set interface, the flat baseline.
+template<class K>
+class SortedVectorSet {
+public:
+    using iterator = typename std::vector<K>::const_iterator;
+
+    SortedVectorSet() = default;
+    template<typename Iterator>
+    SortedVectorSet(Iterator beginit, Iterator endit) : keys_(beginit, endit) {
+        std::sort(keys_.begin(), keys_.end());
+        keys_.erase(std::unique(keys_.begin(), keys_.end(), [](const K& a, const K& b) { return !(a < b); }),
+                    keys_.end());
+    }
+    size_t size() const {
+        return keys_.size();
+    }
+    void insert(const K& k) {
+        auto it = std::lower_bound(keys_.begin(), keys_.end(), k);
+        if (it == keys_.end() || k < *it) {
+            keys_.insert(it, k);
+        }
+    }
+    void erase(const K& k) {
+        auto it = std::lower_bound(keys_.begin(), keys_.end(), k);
+        if (it != keys_.end() && !(k < *it)) {
+            keys_.erase(it);
+        }
+    }
+    iterator find(const K& k) const {
+        auto it = std::lower_bound(keys_.begin(), keys_.end(), k);
+        if (it != keys_.end() && !(k < *it)) {
+            return it;
+        }
+        return keys_.end();
+    }
+    iterator lower_bound(const K& k) const {
+        return std::lower_bound(keys_.begin(), keys_.end(), k);
+    }
+    iterator begin() const {
+        return keys_.begin();
+    }
+    iterator end() const {
+        return keys_.end();
+    }
+private:
+    std::vector<K> keys_;
+};
+
+}  // namespace bench
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Histogram of latencies in the style of HdrHistogram (http://hdrhistogram.org): values below kSubBuckets are
+// recorded exactly, larger values in kSubBuckets linear buckets per power of two, so every recorded value is within
+// 1 / kSubBuckets of its bucket bounds over the whole uint64_t range. Recording is O(1) and does not allocate.
+
+namespace bench {
+
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 7;
+    static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBucketBits;
+
+    LatencyHistogram() : counts_((64 - kSubBucketBits + 1) * kSubBuckets) {
+    }
+    // Records count occurrences of the value.
+    void Record(uint64_t value, uint64_t count = 1) {
+        counts_[Index(value)] += count;
+        total_ += count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+    uint64_t count() const {
+        return total_;
+    }
+    uint64_t min() const {
+        return total_ == 0 ? 0 : min_;
+    }
+    uint64_t max() const {
+        return max_;
+    }
+    // Returns the value at the given percentile (0 to 100): the largest value of the bucket holding it, clamped to
+    // the maximal recorded value.
+    uint64_t Percentile(double percentile) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total_));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(UpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+    // Adds the counts of another histogram.
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+private:
+    static size_t Index(uint64_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        int shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+        return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+    }
+    static uint64_t UpperBound(size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        int shift = static_cast<int>(index / kSubBuckets) - 1;
+        uint64_t sub = index % kSubBuckets + kSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+};
+
+}  // namespace bench
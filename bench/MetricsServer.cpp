@@ -0,0 +1,151 @@
+// Example of publishing set metrics (SetMetrics.h): a worker thread churns a counting set of sessions under a mutex,
+// a second set of names is built once, both are registered in the global registry, and the metrics are served in the
+// Prometheus text format over HTTP on the loopback interface.
+//
+// Usage: set_metrics_server [--port=N] [--requests=N] [--output=FILE]
+//   --port      TCP port on 127.0.0.1 (9464 by default); scrape it with curl http://127.0.0.1:9464/metrics.
+//   --requests  exit after serving N requests, 0 (the default) serves until killed.
+//   --output    write the metrics to FILE once, as for the node_exporter textfile collector, instead of serving.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "SetMetrics.h"
+
+namespace {
+
+struct ServerOptions {
+    int port = 9464;
+    int requests = 0;
+    std::string output;
+};
+
+// Sends the whole buffer, returns false if the connection is closed.
+bool SendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Serves every request with the metrics, whatever the path. Returns the process exit code.
+int Serve(const ServerOptions& options) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::perror("socket");
+        return 1;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        std::perror("bind");
+        close(listener);
+        return 1;
+    }
+    std::printf("serving metrics on http://127.0.0.1:%d/metrics\n", options.port);
+    std::fflush(stdout);
+    for (int served = 0; options.requests == 0 || served < options.requests; ++served) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            std::perror("accept");
+            continue;
+        }
+        // The request itself is not parsed, reading its first part is enough for the clients to get the response.
+        char request[4096];
+        (void)recv(client, request, sizeof(request), 0);
+        std::string body = SetMetricsRegistry::Global().RenderPrometheus();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        SendAll(client, response);
+        close(client);
+    }
+    close(listener);
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ServerOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--port=", 0) == 0) {
+            options.port = std::atoi(value.c_str());
+        } else if (arg.rfind("--requests=", 0) == 0) {
+            options.requests = std::atoi(value.c_str());
+        } else if (arg.rfind("--output=", 0) == 0) {
+            options.output = value;
+        } else {
+            std::fprintf(stderr, "usage: %s [--port=N] [--requests=N] [--output=FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Set<int64_t, NodeAllocator<int64_t>, CountingSetOptions> sessions;
+    std::mutex sessions_mutex;
+    Set<std::string> names;
+    for (int i = 0; i < 1000; ++i) {
+        names.insert("name" + std::to_string(i));
+    }
+    SetMetricsRegistry& registry = SetMetricsRegistry::Global();
+    SetMetricsRegistry::Registration sessions_registration = registry.Register("sessions", sessions, sessions_mutex);
+    SetMetricsRegistry::Registration names_registration = registry.Register("names", names);
+
+    // Sessions come and go at random, about 100000 of them are open at a time.
+    std::atomic<bool> stop(false);
+    std::thread worker([&]() {
+        std::mt19937_64 rng(1);
+        while (!stop.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard<std::mutex> lock(sessions_mutex);
+                for (int i = 0; i < 1000; ++i) {
+                    int64_t session = static_cast<int64_t>(rng() % 200000);
+                    if (rng() % 2 == 0) {
+                        sessions.insert(session);
+                    } else {
+                        sessions.erase(session);
+                    }
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    int status = 0;
+    try {
+        if (!options.output.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            registry.WritePrometheus(options.output);
+        } else {
+            status = Serve(options);
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        status = 1;
+    }
+    stop.store(true);
+    worker.join();
+    return status;
+}
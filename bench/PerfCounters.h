@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware event counters of the calling thread, read through perf_event_open(2). Only user-space events are
+// counted, which perf_event_paranoid 2 (the default) allows. Every event is opened separately: events the CPU or the
+// kernel does not support (for example in containers and virtual machines without a virtual PMU) are skipped and the
+// rest are still counted. Counts are scaled when the kernel multiplexes the events. Off Linux nothing is counted.
+
+namespace bench {
+
+class PerfCounters {
+public:
+    enum Event {
+        kCycles,
+        kInstructions,
+        kL1dMisses,
+        kLlcMisses,
+        kBranchMisses,
+        kDtlbMisses,
+        kEvents,
+    };
+
+    // Opens the counters if enabled is true, they are stopped until Start is called.
+    explicit PerfCounters(bool enabled) {
+        for (int e = 0; e < kEvents; ++e) {
+            fds_[e] = enabled ? Open(static_cast<Event>(e)) : -1;
+        }
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : fds_) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+#endif
+    }
+    static const char* Name(Event e) {
+        static const char* const kNames[kEvents] = {"cycles",      "instructions", "L1d_misses",
+                                                    "LLC_misses",  "branch_misses", "dTLB_misses"};
+        return kNames[e];
+    }
+    // Returns true if the event is counted.
+    bool available(Event e) const {
+        return fds_[e] != -1;
+    }
+    // Returns the error of the first event that could not be opened, or an empty string.
+    const std::string& error() const {
+        return error_;
+    }
+    // Starts or resumes counting.
+    void Start() {
+        Control(PERF_EVENT_IOC_ENABLE);
+    }
+    // Stops counting, the counts are kept.
+    void Stop() {
+        Control(PERF_EVENT_IOC_DISABLE);
+    }
+    // Returns the count of the event since the construction, 0 if the event is not counted.
+    double Read(Event e) const {
+#ifdef __linux__
+        uint64_t values[3];  // Value, time enabled, time running.
+        if (fds_[e] == -1 || read(fds_[e], values, sizeof(values)) != sizeof(values) || values[2] == 0) {
+            return 0;
+        }
+        return static_cast<double>(values[0]) * values[1] / values[2];
+#else
+        (void)e;
+        return 0;
+#endif
+    }
+private:
+#ifndef __linux__
+    static constexpr unsigned long PERF_EVENT_IOC_ENABLE = 0;
+    static constexpr unsigned long PERF_EVENT_IOC_DISABLE = 0;
+#endif
+    int Open(Event e) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        constexpr uint64_t kReadMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        switch (e) {
+            case kCycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case kInstructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case kL1dMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | kReadMiss;
+                break;
+            case kLlcMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            case kBranchMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case kDtlbMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_DTLB | kReadMiss;
+                break;
+            case kEvents:
+                return -1;
+        }
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd == -1 && error_.empty()) {
+            error_ = std::string(Name(e)) + ": " + std::strerror(errno);
+        }
+        return fd;
+#else
+        (void)e;
+        if (error_.empty()) {
+            error_ = "perf_event_open is not supported on this platform";
+        }
+        return -1;
+#endif
+    }
+    void Control(unsigned long request) {
+#ifdef __linux__
+        for (int fd : fds_) {
+            if (fd != -1) {
+                ioctl(fd, request, 0);
+            }
+        }
+#else
+        (void)request;
+#endif
+    }
+private:
+    int fds_[kEvents];
+    std::string error_;
+};
+
+}  // namespace bench
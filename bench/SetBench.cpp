@@ -0,0 +1,360 @@
+// Microbenchmarks of Set against std::set, a sorted vector and, when available, boost::container::flat_set and
+// absl::btree_set; the lookups and the iteration also against MappedSet. Every benchmark performs n operations per
+// iteration on a set of n keys and reports the time per operation in the per_op counter.
+//
+// Usage: set_bench [--set_max_size=N] [--set_perf_counters=0]
+//                  [Google Benchmark flags, e.g. --benchmark_filter=find/Set/]
+// Sizes go from 1e2 to --set_max_size (1e6 by default, up to 1e8) in powers of 10. Insertion and erasure into
+// the flat containers are quadratic, they are measured up to 1e5 keys.
+// The timed parts are also measured with hardware counters (PerfCounters.h), reported per operation as cycles,
+// instructions, L1d_misses, LLC_misses, branch_misses and dTLB_misses. Counters which can not be opened are left out,
+// with a note on stderr.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <type_traits>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "PerfCounters.h"
+#include "SetTemplate.h"
+
+#if __has_include(<sys/mman.h>)
+#define SET_BENCH_HAVE_MMAP
+#include "MappedSet.h"
+#endif
+
+#ifdef SET_BENCH_HAVE_BOOST
+#include <boost/container/flat_set.hpp>
+#endif
+#ifdef SET_BENCH_HAVE_ABSL
+#include <absl/container/btree_set.h>
+#endif
+
+namespace {
+
+using bench::MakeKey;
+using bench::Order;
+
+constexpr int64_t kMinSize = 100;
+constexpr int64_t kFlatMaxSize = 100000;
+
+bool g_perf_counters = true;
+
+// Returns a value depending on the key, so that the iteration can not be optimized out.
+inline uint64_t KeyWeight(int32_t k) {
+    return k;
+}
+inline uint64_t KeyWeight(int64_t k) {
+    return k;
+}
+inline uint64_t KeyWeight(const std::string& k) {
+    return k.size() + k.back();
+}
+inline uint64_t KeyWeight(const bench::Pod64& k) {
+    return k.id;
+}
+
+// The set holds the keys 2i for i in [0, n). Lookups of 2i hit, lower bounds of 2i + 1 fall between the keys.
+template<class K>
+std::vector<K> SetKeys(int64_t n, Order order) {
+    std::vector<K> keys;
+    keys.reserve(n);
+    for (uint64_t i : bench::MakeOrder(order, n, n)) {
+        keys.push_back(MakeKey<K>(2 * i));
+    }
+    return keys;
+}
+
+template<class K>
+std::vector<K> ProbeKeys(int64_t n, Order order, uint64_t shift) {
+    std::vector<K> keys;
+    keys.reserve(n);
+    for (uint64_t i : bench::MakeOrder(order, n, n, 7)) {
+        keys.push_back(MakeKey<K>(2 * i + shift));
+    }
+    return keys;
+}
+
+// Opens the hardware counters of a benchmark run, notes on stderr once if some of them are unavailable.
+class Counters : public bench::PerfCounters {
+public:
+    Counters() : PerfCounters(g_perf_counters) {
+        static bool reported = false;
+        if (!error().empty() && !reported) {
+            reported = true;
+            std::fprintf(stderr, "Some hardware counters are unavailable (%s), they are not reported\n",
+                         error().c_str());
+        }
+    }
+};
+
+// Stops the timer and the counters for the untimed part of an iteration.
+void PauseTiming(benchmark::State& state, Counters& perf) {
+    perf.Stop();
+    state.PauseTiming();
+}
+void ResumeTiming(benchmark::State& state, Counters& perf) {
+    state.ResumeTiming();
+    perf.Start();
+}
+
+void ReportPerOp(benchmark::State& state, int64_t n, Counters& perf) {
+    perf.Stop();
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["per_op"] = benchmark::Counter(static_cast<double>(n),
+                                                  benchmark::Counter::kIsIterationInvariantRate |
+                                                  benchmark::Counter::kInvert);
+    for (int e = 0; e < bench::PerfCounters::kEvents; ++e) {
+        auto event = static_cast<bench::PerfCounters::Event>(e);
+        if (perf.available(event)) {
+            state.counters[bench::PerfCounters::Name(event)] =
+                benchmark::Counter(perf.Read(event) / n, benchmark::Counter::kAvgIterations);
+        }
+    }
+}
+
+template<class C, class K>
+void Insert(benchmark::State& state, Order order) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, order);
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        std::optional<C> c;
+        c.emplace();
+        for (const K& k : keys) {
+            c->insert(k);
+        }
+        benchmark::ClobberMemory();
+        PauseTiming(state, perf);
+        c.reset();
+        ResumeTiming(state, perf);
+    }
+    ReportPerOp(state, n, perf);
+}
+
+template<class C, class K>
+void Erase(benchmark::State& state, Order order) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, Order::kUniform);
+    const C base(keys.begin(), keys.end());
+    keys = SetKeys<K>(n, order);
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        PauseTiming(state, perf);
+        std::optional<C> c(base);
+        ResumeTiming(state, perf);
+        for (const K& k : keys) {
+            c->erase(k);
+        }
+        benchmark::ClobberMemory();
+    }
+    ReportPerOp(state, n, perf);
+}
+
+template<class C, class K>
+void Find(benchmark::State& state, Order order) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, Order::kUniform);
+    const C c(keys.begin(), keys.end());
+    std::vector<K> probes = ProbeKeys<K>(n, order, 0);
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        int64_t found = 0;
+        for (const K& k : probes) {
+            found += c.find(k) != c.end();
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    ReportPerOp(state, n, perf);
+}
+
+template<class C, class K>
+void LowerBound(benchmark::State& state, Order order) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, Order::kUniform);
+    const C c(keys.begin(), keys.end());
+    std::vector<K> probes = ProbeKeys<K>(n, order, 1);
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (const K& k : probes) {
+            auto it = c.lower_bound(k);
+            if (it != c.end()) {
+                sum += KeyWeight(*it.operator->());
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportPerOp(state, n, perf);
+}
+
+template<class C, class K>
+void Iterate(benchmark::State& state) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, Order::kUniform);
+    const C c(keys.begin(), keys.end());
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (auto it = c.begin(); it != c.end(); ++it) {
+            sum += KeyWeight(*it.operator->());
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportPerOp(state, n, perf);
+}
+
+template<class C, class K>
+void Copy(benchmark::State& state) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, Order::kUniform);
+    const C c(keys.begin(), keys.end());
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        std::optional<C> copy(c);
+        benchmark::ClobberMemory();
+        PauseTiming(state, perf);
+        copy.reset();
+        ResumeTiming(state, perf);
+    }
+    ReportPerOp(state, n, perf);
+}
+
+template<class C, class K>
+void RangeConstruct(benchmark::State& state) {
+    int64_t n = state.range(0);
+    std::vector<K> keys = SetKeys<K>(n, Order::kUniform);
+    Counters perf;
+    perf.Start();
+    for (auto _ : state) {
+        std::optional<C> c(std::in_place, keys.begin(), keys.end());
+        benchmark::ClobberMemory();
+        PauseTiming(state, perf);
+        c.reset();
+        ResumeTiming(state, perf);
+    }
+    ReportPerOp(state, n, perf);
+}
+
+#ifdef SET_BENCH_HAVE_MMAP
+// MappedSet of the keys, in a temporary file removed once it is mapped.
+template<class K>
+class TemporaryMappedSet : public MappedSet<K> {
+public:
+    template<class Iterator>
+    TemporaryMappedSet(Iterator first, Iterator last) : MappedSet<K>(Map(std::vector<K>(first, last))) {}
+private:
+    static MappedSet<K> Map(std::vector<K> keys) {
+        std::sort(keys.begin(), keys.end());
+        char path[] = "/tmp/set_bench_XXXXXX";
+        int fd = ::mkstemp(path);
+        if (fd < 0) {
+            std::perror("mkstemp");
+            std::exit(1);
+        }
+        ::close(fd);
+        MappedSet<K>::write(path, keys.begin(), keys.end());
+        MappedSet<K> set(path);
+        ::unlink(path);
+        return set;
+    }
+};
+#endif
+
+// Registers the lookups and the iteration only, for the read-only backends.
+template<class C, class K>
+void RegisterReadOnlyBackend(const std::string& backend, int64_t max_size) {
+    std::string suffix = "/" + backend + "/" + bench::KeyName<K>();
+    auto sizes = [](benchmark::internal::Benchmark* b, int64_t max) {
+        b->RangeMultiplier(10)->Range(kMinSize, max)->Unit(benchmark::kMillisecond);
+    };
+    for (Order order : {Order::kSequential, Order::kUniform, Order::kZipfian}) {
+        std::string o = std::string("/") + bench::OrderName(order);
+        sizes(benchmark::RegisterBenchmark(("find" + suffix + o).c_str(), Find<C, K>, order), max_size);
+        sizes(benchmark::RegisterBenchmark(("lower_bound" + suffix + o).c_str(), LowerBound<C, K>, order), max_size);
+    }
+    sizes(benchmark::RegisterBenchmark(("iterate" + suffix).c_str(), Iterate<C, K>), max_size);
+}
+
+template<class C, class K>
+void RegisterBackend(const std::string& backend, int64_t max_size, bool flat) {
+    std::string suffix = "/" + backend + "/" + bench::KeyName<K>();
+    int64_t update_max_size = flat ? std::min(max_size, kFlatMaxSize) : max_size;
+    auto sizes = [](benchmark::internal::Benchmark* b, int64_t max) {
+        b->RangeMultiplier(10)->Range(kMinSize, max)->Unit(benchmark::kMillisecond);
+    };
+    for (Order order : {Order::kSequential, Order::kUniform}) {
+        std::string o = std::string("/") + bench::OrderName(order);
+        sizes(benchmark::RegisterBenchmark(("insert" + suffix + o).c_str(), Insert<C, K>, order), update_max_size);
+        sizes(benchmark::RegisterBenchmark(("erase" + suffix + o).c_str(), Erase<C, K>, order), update_max_size);
+    }
+    for (Order order : {Order::kSequential, Order::kUniform, Order::kZipfian}) {
+        std::string o = std::string("/") + bench::OrderName(order);
+        sizes(benchmark::RegisterBenchmark(("find" + suffix + o).c_str(), Find<C, K>, order), max_size);
+        sizes(benchmark::RegisterBenchmark(("lower_bound" + suffix + o).c_str(), LowerBound<C, K>, order), max_size);
+    }
+    sizes(benchmark::RegisterBenchmark(("iterate" + suffix).c_str(), Iterate<C, K>), max_size);
+    sizes(benchmark::RegisterBenchmark(("copy" + suffix).c_str(), Copy<C, K>), max_size);
+    sizes(benchmark::RegisterBenchmark(("range_construct" + suffix).c_str(), RangeConstruct<C, K>), max_size);
+}
+
+template<class K>
+void RegisterKey(int64_t max_size) {
+    RegisterBackend<Set<K>, K>("Set", max_size, false);
+    RegisterBackend<std::set<K>, K>("std::set", max_size, false);
+    RegisterBackend<bench::SortedVectorSet<K>, K>("sorted_vector", max_size, true);
+#ifdef SET_BENCH_HAVE_BOOST
+    RegisterBackend<boost::container::flat_set<K>, K>("flat_set", max_size, true);
+#endif
+#ifdef SET_BENCH_HAVE_ABSL
+    RegisterBackend<absl::btree_set<K>, K>("btree_set", max_size, false);
+#endif
+#ifdef SET_BENCH_HAVE_MMAP
+    if constexpr (std::is_trivially_copyable<K>::value) {
+        RegisterReadOnlyBackend<TemporaryMappedSet<K>, K>("MappedSet", max_size);
+    }
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int64_t max_size = 1000000;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--set_max_size=", 0) == 0) {
+            max_size = static_cast<int64_t>(std::atof(arg.c_str() + arg.find('=') + 1));
+        } else if (arg.rfind("--set_perf_counters=", 0) == 0) {
+            g_perf_counters = std::atoi(arg.c_str() + arg.find('=') + 1) != 0;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    RegisterKey<int32_t>(max_size);
+    RegisterKey<int64_t>(max_size);
+    RegisterKey<std::string>(max_size);
+    RegisterKey<bench::Pod64>(max_size);
+
+    int bench_argc = static_cast<int>(args.size());
+    benchmark::Initialize(&bench_argc, args.data());
+    if (benchmark::ReportUnrecognizedArguments(bench_argc, args.data())) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,211 @@
+// Sets far larger than the last level cache: builds a Set<int64_t> of --size keys (1e8 by default) and measures the
+// cold-cache find, lower_bound and full scan, optionally copy, and the teardown. Every phase reports the time per
+// operation and, when perf_event_open is available (PerfCounters.h), LLC and dTLB misses per operation.
+//
+// Usage: set_large [--size=N] [--probes=N] [--order=random|sequential] [--hugepages] [--copy] [--force]
+//   --order      insertion order of the keys. Random order scatters the vertices of neighbouring keys over the heap,
+//                as in a long-lived set; sequential order allocates them in key order, so scans walk memory forwards.
+//   --hugepages  allocate the vertices from one arena advised for transparent huge pages (madvise MADV_HUGEPAGE),
+//                through pmr::Set over a monotonic_buffer_resource; the teardown is then skipped.
+//   --copy       also copy the set, which needs twice the memory.
+// The expected footprint is checked against MemAvailable first; --force runs anyway.
+// The recursion in the teardown and the copy goes as deep as the tree height, at most SetStats::HeightBound(n), which
+// is printed with the results.
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <string>
+
+#include "PerfCounters.h"
+#include "SetTemplate.h"
+
+namespace {
+
+using bench::PerfCounters;
+
+// Upper estimate of the bytes per key: the AVL vertex with an int64_t key, the allocator slack and the heap overhead.
+constexpr double kBytesPerKey = sizeof(AvlHook) + sizeof(int64_t) + 8;
+
+// Receives the results of the lookups, so that they can not be optimized out.
+volatile uint64_t g_sink;
+
+struct LargeOptions {
+    uint64_t size = 100000000;
+    uint64_t probes = 10000000;
+    bool sequential = false;
+    bool hugepages = false;
+    bool copy = false;
+    bool force = false;
+};
+
+// Bijective mix of 64-bit values (the splitmix64 finalizer), so the keys of random order are distinct.
+uint64_t Mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Key i of the set. Keys are even, so key + 1 falls between the keys.
+int64_t KeyOf(uint64_t i, bool sequential) {
+    return static_cast<int64_t>((sequential ? i : Mix(i) >> 2) * 2);
+}
+
+uint64_t MemAvailable() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string name;
+    uint64_t kb = 0;
+    std::string unit;
+    while (meminfo >> name >> kb >> unit) {
+        if (name == "MemAvailable:") {
+            return kb * 1024;
+        }
+    }
+    return 0;
+}
+
+uint64_t ResidentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Times a phase of ops operations and prints a row of results.
+template<class F>
+void Phase(const char* name, uint64_t ops, F&& f) {
+    PerfCounters perf(true);
+    auto start = std::chrono::steady_clock::now();
+    perf.Start();
+    f();
+    perf.Stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-12s %12llu %10.3f %10.1f", name, static_cast<unsigned long long>(ops), seconds,
+                ops == 0 ? 0.0 : seconds * 1e9 / ops);
+    for (PerfCounters::Event e : {PerfCounters::kLlcMisses, PerfCounters::kDtlbMisses}) {
+        if (perf.available(e) && ops != 0) {
+            std::printf(" %12.2f", perf.Read(e) / ops);
+        } else {
+            std::printf(" %12s", "-");
+        }
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+}
+
+template<class S>
+void Run(std::optional<S>& s, const LargeOptions& options) {
+    uint64_t n = options.size;
+    std::printf("%-12s %12s %10s %10s %12s %12s\n", "phase", "ops", "seconds", "ns/op", "LLC/op", "dTLB/op");
+    uint64_t rss = ResidentBytes();
+    Phase("build", n, [&]() {
+        for (uint64_t i = 0; i < n; ++i) {
+            s->insert(KeyOf(i, options.sequential));
+        }
+    });
+    double bytes_per_key = static_cast<double>(ResidentBytes() - rss) / n;
+
+    std::mt19937_64 rng(7);
+    Phase("find", options.probes, [&]() {
+        uint64_t found = 0;
+        for (uint64_t i = 0; i < options.probes; ++i) {
+            found += s->find(KeyOf(rng() % n, options.sequential)) != s->end();
+        }
+        g_sink = found;
+    });
+    Phase("lower_bound", options.probes, [&]() {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < options.probes; ++i) {
+            auto it = s->lower_bound(KeyOf(rng() % n, options.sequential) + 1);
+            if (it != s->end()) {
+                sum += *it;
+            }
+        }
+        g_sink = sum;
+    });
+    Phase("scan", n, [&]() {
+        uint64_t sum = 0;
+        for (auto it = s->begin(); it != s->end(); ++it) {
+            sum += *it;
+        }
+        g_sink = sum;
+    });
+    if (options.copy) {
+        std::optional<S> copy;
+        Phase("copy", n, [&]() { copy.emplace(*s, s->get_allocator()); });
+        Phase("destroy_copy", n, [&]() { copy.reset(); });
+    }
+    Phase("destroy", n, [&]() { s.reset(); });
+    std::printf("resident bytes per key %.1f, tree height at most %.0f\n", bytes_per_key,
+                std::floor(SetStats::HeightBound(n)));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    LargeOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--size=", 0) == 0) {
+            options.size = std::max<uint64_t>(1, static_cast<uint64_t>(std::atof(value.c_str())));
+        } else if (arg.rfind("--probes=", 0) == 0) {
+            options.probes = static_cast<uint64_t>(std::atof(value.c_str()));
+        } else if (arg.rfind("--order=", 0) == 0) {
+            options.sequential = value == "sequential";
+        } else if (arg == "--hugepages") {
+            options.hugepages = true;
+        } else if (arg == "--copy") {
+            options.copy = true;
+        } else if (arg == "--force") {
+            options.force = true;
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    double needed = kBytesPerKey * options.size * (options.copy ? 2 : 1);
+    uint64_t available = MemAvailable();
+    std::printf("%llu keys, about %.2f GiB needed, %.2f GiB available\n",
+                static_cast<unsigned long long>(options.size), needed / (1 << 30),
+                static_cast<double>(available) / (1 << 30));
+    if (available != 0 && needed > available && !options.force) {
+        std::fprintf(stderr, "not enough memory, use a smaller --size or --force\n");
+        return 1;
+    }
+
+    if (!options.hugepages) {
+        std::optional<Set<int64_t>> s(std::in_place);
+        Run(s, options);
+        return 0;
+    }
+    // The arena only reserves address space, pages are committed as the vertices are allocated. Allocations beyond
+    // it fall back to the default resource.
+    size_t arena_bytes = static_cast<size_t>(needed) + (size_t(1) << 21);
+    void* arena = mmap(nullptr, arena_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                       0);
+    if (arena == MAP_FAILED) {
+        std::perror("mmap");
+        return 1;
+    }
+    if (madvise(arena, arena_bytes, MADV_HUGEPAGE) != 0) {
+        std::perror("madvise(MADV_HUGEPAGE), continuing with normal pages");
+    }
+    {
+        std::pmr::monotonic_buffer_resource resource(arena, arena_bytes, std::pmr::new_delete_resource());
+        std::optional<pmr::Set<int64_t>> s(std::in_place, &resource);
+        Run(s, options);
+    }
+    munmap(arena, arena_bytes);
+    return 0;
+}
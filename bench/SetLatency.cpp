@@ -0,0 +1,208 @@
+// Latency distribution of single operations under steady-state churn: every operation of a synthetic workload
+// (Workload.h, the churn preset by default: 40% finds, 30% inserts, 30% erases over a set of --preload keys) is timed
+// separately and recorded into a histogram per operation type, which reports p50 to p99.99 and the maximum.
+//
+// Usage: set_latency [--workload=NAME] [--preload=N] [--operations=N] [--key=int64|string] [--timer=tsc|clock]
+//                    [--batch=B] [--backend=NAME]
+// The workload options are those of set_tracegen (Workload.h).
+// The tsc timer (default on x86-64) reads the time stamp counter, calibrated against steady_clock; the clock timer
+// uses steady_clock. The timer overhead, printed at the start, is included in the latencies. With --batch=B every B
+// consecutive operations are timed together and their mean is recorded under "batch": this hides the timer overhead
+// for short operations, but also flattens the tail.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SET_BENCH_HAVE_TSC 1
+#endif
+
+#include "LatencyHistogram.h"
+#include "SetTemplate.h"
+#include "Workload.h"
+
+#ifdef SET_BENCH_HAVE_ABSL
+#include <absl/container/btree_set.h>
+#endif
+
+namespace {
+
+using bench::Execute;
+using bench::kOpNames;
+using bench::kOpTypes;
+using bench::LatencyHistogram;
+
+// Receives the results of the lookups, so that they can not be optimized out.
+volatile size_t g_sink;
+
+// Reads timestamps as ticks and converts tick differences to nanoseconds.
+class Timer {
+public:
+    explicit Timer(bool tsc) : tsc_(tsc) {
+        if (!tsc_) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        uint64_t ticks = Now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50)) {
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        ns_per_tick_ = ns / static_cast<double>(Now() - ticks);
+    }
+    // Returns the current timestamp in ticks. The fences keep the time stamp counter read from being reordered with
+    // the measured code.
+    uint64_t Now() const {
+#ifdef SET_BENCH_HAVE_TSC
+        if (tsc_) {
+            _mm_lfence();
+            uint64_t t = __rdtsc();
+            _mm_lfence();
+            return t;
+        }
+#endif
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    uint64_t ToNs(uint64_t ticks) const {
+        return tsc_ ? static_cast<uint64_t>(ticks * ns_per_tick_ + 0.5) : ticks;
+    }
+    // Returns the median time of an empty measurement.
+    uint64_t Overhead() const {
+        LatencyHistogram h;
+        for (int i = 0; i < 10000; ++i) {
+            uint64_t start = Now();
+            h.Record(ToNs(Now() - start));
+        }
+        return h.Percentile(50);
+    }
+private:
+    bool tsc_;
+    double ns_per_tick_ = 1.0;
+};
+
+struct LatencyOptions {
+    size_t skip = 0;
+    size_t batch = 1;
+    std::string backend;
+};
+
+void PrintRow(const char* op, const LatencyHistogram& h) {
+    if (h.count() == 0) {
+        return;
+    }
+    std::printf("  %-12s %10llu %8llu %8llu %8llu %8llu %8llu %10llu\n", op,
+                static_cast<unsigned long long>(h.count()), static_cast<unsigned long long>(h.Percentile(50)),
+                static_cast<unsigned long long>(h.Percentile(90)), static_cast<unsigned long long>(h.Percentile(99)),
+                static_cast<unsigned long long>(h.Percentile(99.9)),
+                static_cast<unsigned long long>(h.Percentile(99.99)), static_cast<unsigned long long>(h.max()));
+}
+
+template<class C, class K>
+void Measure(const char* backend, const std::vector<TraceRecord<K>>& trace, const Timer& timer,
+             const LatencyOptions& options) {
+    if (!options.backend.empty() && options.backend != backend) {
+        return;
+    }
+    C c;
+    size_t sink = 0;
+    for (size_t i = 0; i < options.skip; ++i) {
+        sink += Execute(c, trace[i]);
+    }
+    LatencyHistogram by_op[kOpTypes];
+    LatencyHistogram all;
+    if (options.batch <= 1) {
+        for (size_t i = options.skip; i < trace.size(); ++i) {
+            uint64_t start = timer.Now();
+            sink += Execute(c, trace[i]);
+            uint64_t ns = timer.ToNs(timer.Now() - start);
+            by_op[static_cast<size_t>(trace[i].op)].Record(ns);
+            all.Record(ns);
+        }
+    } else {
+        for (size_t i = options.skip; i + options.batch <= trace.size(); i += options.batch) {
+            uint64_t start = timer.Now();
+            for (size_t j = i; j < i + options.batch; ++j) {
+                sink += Execute(c, trace[j]);
+            }
+            all.Record(timer.ToNs(timer.Now() - start) / options.batch, options.batch);
+        }
+    }
+    g_sink = sink;
+
+    std::printf("%s\n", backend);
+    for (size_t op = 0; op < kOpTypes; ++op) {
+        PrintRow(kOpNames[op], by_op[op]);
+    }
+    PrintRow(options.batch <= 1 ? "all" : "batch", all);
+}
+
+template<class K>
+void MeasureAll(const bench::WorkloadSpec& spec, const Timer& timer, LatencyOptions options) {
+    std::vector<TraceRecord<K>> trace = bench::GenerateWorkload<K>(spec, &options.skip);
+    std::printf("%-14s %10s %8s %8s %8s %8s %8s %10s  (ns)\n", "", "count", "p50", "p90", "p99", "p99.9", "p99.99",
+                "max");
+    Measure<Set<K>, K>("Set", trace, timer, options);
+    Measure<Set<K, NodeAllocator<K>, ParentlessSetOptions>, K>("Set/parentless", trace, timer, options);
+    Measure<std::set<K>, K>("std::set", trace, timer, options);
+#ifdef SET_BENCH_HAVE_ABSL
+    Measure<absl::btree_set<K>, K>("btree_set", trace, timer, options);
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string key = "int64";
+#ifdef SET_BENCH_HAVE_TSC
+    bool tsc = true;
+#else
+    bool tsc = false;
+#endif
+    LatencyOptions options;
+    try {
+        std::vector<std::string> args;
+        bench::WorkloadSpec spec = bench::ParseWorkloadOptions(argc, argv, "churn", args);
+        for (const std::string& arg : args) {
+            std::string value = arg.substr(arg.find('=') + 1);
+            if (arg.rfind("--key=", 0) == 0) {
+                key = value;
+            } else if (arg.rfind("--timer=", 0) == 0) {
+                tsc = value == "tsc";
+            } else if (arg.rfind("--batch=", 0) == 0) {
+                options.batch = static_cast<size_t>(std::atoi(value.c_str()));
+            } else if (arg.rfind("--backend=", 0) == 0) {
+                options.backend = value;
+            } else {
+                std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+                return 1;
+            }
+        }
+#ifndef SET_BENCH_HAVE_TSC
+        if (tsc) {
+            std::fprintf(stderr, "the tsc timer is not available on this platform\n");
+            return 1;
+        }
+#endif
+        Timer timer(tsc);
+        std::printf("timer %s, overhead %llu ns\n", tsc ? "tsc" : "clock",
+                    static_cast<unsigned long long>(timer.Overhead()));
+        if (key == "int64") {
+            MeasureAll<int64_t>(spec, timer, options);
+        } else if (key == "string") {
+            MeasureAll<std::string>(spec, timer, options);
+        } else {
+            std::fprintf(stderr, "unknown key type %s\n", key.c_str());
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
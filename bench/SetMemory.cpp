@@ -0,0 +1,225 @@
+// Memory footprint of Set against std::set (and absl::btree_set when available): bytes per element at growing sizes
+// for every key type.
+//
+// Usage: set_memory [--max_size=N]
+// Sizes go from 1e3 to --max_size (1e6 by default) in powers of 10. Every measurement runs in a forked child, so the
+// heap and the node cache start empty. Columns, per element:
+//   node     bytes of one allocation made by the container (sizeof(Node) for the node-based ones)
+//   key      sizeof(key)
+//   links    the link fields of the node: height, sons, parent and is_end for Set; color, parent and sons for std::set
+//   padding  node - key - links
+//   alloc    bytes requested from the container allocator
+//   system   bytes taken from the global allocator (malloc_usable_size, counting the heap memory of string keys and
+//            the slabs of NodeAllocator): alloc plus the allocator slack
+//   rss      growth of the resident set (/proc/self/statm), which also counts malloc headers and fragmentation
+//            (page granular, so it is only meaningful at the larger sizes)
+
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "SetTemplate.h"
+
+#ifdef SET_BENCH_HAVE_ABSL
+#include <absl/container/btree_set.h>
+#endif
+
+namespace {
+
+// Bytes taken from the global allocator and bytes requested from the container allocators in this process.
+size_t g_system_bytes = 0;
+size_t g_alloc_bytes = 0;
+size_t g_alloc_max_size = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    g_system_bytes += malloc_usable_size(p);
+    return p;
+}
+void* operator new(size_t size, std::align_val_t align) {
+    size_t a = static_cast<size_t>(align);
+    void* p = std::aligned_alloc(a, (size + a - 1) / a * a);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    g_system_bytes += malloc_usable_size(p);
+    return p;
+}
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        g_system_bytes -= malloc_usable_size(p);
+        std::free(p);
+    }
+}
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    operator delete(p);
+}
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    operator delete(p);
+}
+
+namespace {
+
+// Allocator adaptor, which counts the bytes requested from Base.
+template<class T, class Base>
+class CountingAllocator {
+public:
+    using value_type = T;
+    template<class U>
+    struct rebind {
+        using other = CountingAllocator<U, typename std::allocator_traits<Base>::template rebind_alloc<U>>;
+    };
+
+    CountingAllocator() = default;
+    template<class U, class B>
+    CountingAllocator(const CountingAllocator<U, B>&) noexcept {}
+
+    T* allocate(size_t n) {
+        g_alloc_bytes += n * sizeof(T);
+        g_alloc_max_size = std::max(g_alloc_max_size, n * sizeof(T));
+        return base_.allocate(n);
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        g_alloc_bytes -= n * sizeof(T);
+        base_.deallocate(p, n);
+    }
+    template<class U, class B>
+    bool operator==(const CountingAllocator<U, B>&) const noexcept {
+        return true;
+    }
+    template<class U, class B>
+    bool operator!=(const CountingAllocator<U, B>&) const noexcept {
+        return false;
+    }
+private:
+    Base base_;
+};
+
+size_t ResidentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+struct Footprint {
+    double alloc;
+    double system;
+    double rss;
+    size_t node;
+};
+
+// Builds a container of n keys in a child process and returns its footprint per element.
+template<class C, class K>
+bool Measure(int64_t n, Footprint& result) {
+    int pipes[2];
+    if (pipe(pipes) != 0) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipes[0]);
+        std::vector<K> keys;
+        keys.reserve(n);
+        for (uint64_t i : bench::MakeOrder(bench::Order::kUniform, n, n)) {
+            keys.push_back(bench::MakeKey<K>(i));
+        }
+        size_t system = g_system_bytes;
+        size_t rss = ResidentBytes();
+        auto c = std::make_unique<C>();
+        for (const K& k : keys) {
+            c->insert(k);
+        }
+        Footprint f;
+        f.alloc = static_cast<double>(g_alloc_bytes) / n;
+        f.system = static_cast<double>(g_system_bytes - system) / n;
+        f.rss = static_cast<double>(ResidentBytes() - rss) / n;
+        f.node = g_alloc_max_size;
+        bool ok = write(pipes[1], &f, sizeof(f)) == sizeof(f);
+        _exit(ok ? 0 : 1);
+    }
+    close(pipes[1]);
+    bool ok = pid > 0 && read(pipes[0], &result, sizeof(result)) == sizeof(result);
+    close(pipes[0]);
+    int status = 0;
+    if (pid > 0) {
+        waitpid(pid, &status, 0);
+    }
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+template<class C, class K>
+void Report(const char* backend, int64_t max_size, size_t links) {
+    for (int64_t n = 1000; n <= max_size; n *= 10) {
+        Footprint f;
+        if (!Measure<C, K>(n, f)) {
+            std::fprintf(stderr, "%s/%s/%lld: measurement failed\n", backend, bench::KeyName<K>(),
+                         static_cast<long long>(n));
+            continue;
+        }
+        if (links == 0) {
+            std::printf("%-12s %-7s %9lld %6s %5zu %6s %8s %8.1f %8.1f %8.1f\n", backend, bench::KeyName<K>(),
+                        static_cast<long long>(n), "-", sizeof(K), "-", "-", f.alloc, f.system, f.rss);
+        } else {
+            std::printf("%-12s %-7s %9lld %6zu %5zu %6zu %8zu %8.1f %8.1f %8.1f\n", backend, bench::KeyName<K>(),
+                        static_cast<long long>(n), f.node, sizeof(K), links, f.node - sizeof(K) - links, f.alloc,
+                        f.system, f.rss);
+        }
+    }
+}
+
+template<class K>
+void ReportKey(int64_t max_size) {
+    constexpr size_t kAvlLinks = sizeof(size_t) + 3 * sizeof(void*) + sizeof(bool);
+    constexpr size_t kParentlessLinks = sizeof(size_t) + 2 * sizeof(void*) + sizeof(bool);
+    // libstdc++ and libc++ red-black tree nodes: an int-sized color and three pointers.
+    constexpr size_t kRbLinks = sizeof(int) + 3 * sizeof(void*);
+    Report<Set<K, CountingAllocator<K, NodeAllocator<K>>>, K>("Set", max_size, kAvlLinks);
+    Report<Set<K, CountingAllocator<K, NodeAllocator<K>>, ParentlessSetOptions>, K>("Set/noparent", max_size,
+                                                                                     kParentlessLinks);
+    Report<std::set<K, std::less<K>, CountingAllocator<K, std::allocator<K>>>, K>("std::set", max_size, kRbLinks);
+#ifdef SET_BENCH_HAVE_ABSL
+    // B-tree nodes hold many keys, the per-node columns do not apply.
+    Report<absl::btree_set<K, std::less<K>, CountingAllocator<K, std::allocator<K>>>, K>("btree_set", max_size, 0);
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int64_t max_size = 1000000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--max_size=", 0) == 0) {
+            max_size = static_cast<int64_t>(std::atof(arg.c_str() + arg.find('=') + 1));
+        } else {
+            std::fprintf(stderr, "usage: %s [--max_size=N]\n", argv[0]);
+            return 1;
+        }
+    }
+    std::printf("%-12s %-7s %9s %6s %5s %6s %8s %8s %8s %8s\n", "backend", "key", "size", "node", "key", "links",
+                "padding", "alloc", "system", "rss");
+    ReportKey<int32_t>(max_size);
+    ReportKey<int64_t>(max_size);
+    ReportKey<std::string>(max_size);
+    ReportKey<bench::Pod64>(max_size);
+    return 0;
+}
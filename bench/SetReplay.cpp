@@ -0,0 +1,349 @@
+// Replays a set trace (SetTrace.h), recorded with TracedSet or generated with set_tracegen, against Set, Set without
+// parent links, std::set and, when available, absl::btree_set, and prints the time per operation.
+//
+// Usage: set_replay [--skip=N] [--repetitions=N] [--breakdown] [--counters] [--profile=N] [--heatmap]
+//                   [--backend=NAME] TRACE
+// The first --skip records (the preload printed by set_tracegen) are executed untimed before every repetition. The
+// best of --repetitions (3 by default) runs is reported. --breakdown adds a pass timing every operation separately,
+// which reports the mean time per operation type; it includes the clock overhead of a few tens of nanoseconds.
+// --counters replays the trace once more on a Set with CountingSetOptions and prints its operation counters.
+// --profile=N adds the backend Set/sampled, a Set with SampledSetOptions sampling every N-th operation, whose time
+// against the Set row is the cost of the sampling. It then replays the trace on it once more, drains the samples
+// while replaying as an exporter would, and prints their latency percentiles, depths and comparisons.
+// --heatmap replays it on a Set with AccessCountingSetOptions and prints its access report: the hottest keys and
+// subtrees, the depth of the accesses against the depth of the keys and the entropy of the accesses.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "SetTemplate.h"
+#include "SetTrace.h"
+#include "Workload.h"
+
+#ifdef SET_BENCH_HAVE_ABSL
+#include <absl/container/btree_set.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Receives the results of the lookups, so that they can not be optimized out.
+volatile size_t g_sink;
+
+using bench::Execute;
+using bench::kOpNames;
+using bench::kOpTypes;
+
+struct ReplayOptions {
+    size_t skip = 0;
+    int repetitions = 3;
+    bool breakdown = false;
+    bool counters = false;
+    uint32_t profile = 0;
+    bool heatmap = false;
+    std::string backend;
+};
+
+template<class C, class K>
+void Replay(const std::string& backend, const std::vector<TraceRecord<K>>& trace, const ReplayOptions& options) {
+    if (!options.backend.empty() && options.backend != backend) {
+        return;
+    }
+    size_t skip = std::min(options.skip, trace.size());
+    size_t timed = trace.size() - skip;
+    size_t sink = 0;
+    double best = 0;
+    size_t final_size = 0;
+    for (int r = 0; r < options.repetitions; ++r) {
+        std::optional<C> c(std::in_place);
+        for (size_t i = 0; i < skip; ++i) {
+            sink += Execute(*c, trace[i]);
+        }
+        auto start = Clock::now();
+        for (size_t i = skip; i < trace.size(); ++i) {
+            sink += Execute(*c, trace[i]);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (r == 0 || ns < best) {
+            best = ns;
+        }
+        final_size = c->size();
+    }
+    std::printf("%-14s %12.3f %10.1f %12zu", backend.c_str(), best / 1e6, timed == 0 ? 0.0 : best / timed, final_size);
+
+    if (options.breakdown) {
+        double ns[kOpTypes] = {};
+        size_t count[kOpTypes] = {};
+        C c;
+        for (size_t i = 0; i < skip; ++i) {
+            sink += Execute(c, trace[i]);
+        }
+        for (size_t i = skip; i < trace.size(); ++i) {
+            auto start = Clock::now();
+            sink += Execute(c, trace[i]);
+            auto finish = Clock::now();
+            size_t op = static_cast<size_t>(trace[i].op);
+            ns[op] += std::chrono::duration<double, std::nano>(finish - start).count();
+            ++count[op];
+        }
+        for (size_t op = 0; op < kOpTypes; ++op) {
+            if (count[op] != 0) {
+                std::printf("  %s %.1f", kOpNames[op], ns[op] / count[op]);
+            }
+        }
+    }
+    std::printf("\n");
+    g_sink = sink;
+}
+
+void PrintCounters(const char* op, const OperationCounters& c) {
+    if (c.calls != 0) {
+        std::printf("  %-12s %10llu calls %8.2f comparisons %8.2f depth %4llu max depth\n", op,
+                    static_cast<unsigned long long>(c.calls), c.mean_comparisons(), c.mean_depth(),
+                    static_cast<unsigned long long>(c.max_depth));
+    }
+}
+
+// Replays the trace on a counting set and prints the counters of the timed part.
+template<class K>
+void Count(const std::vector<TraceRecord<K>>& trace, const ReplayOptions& options) {
+    Set<K, NodeAllocator<K>, CountingSetOptions> s;
+    size_t skip = std::min(options.skip, trace.size());
+    size_t sink = 0;
+    for (size_t i = 0; i < skip; ++i) {
+        sink += Execute(s, trace[i]);
+    }
+    s.reset_counters();
+    for (size_t i = skip; i < trace.size(); ++i) {
+        sink += Execute(s, trace[i]);
+    }
+    g_sink = sink;
+    const SetCounters c = s.counters();
+    std::printf("Set counters\n");
+    PrintCounters("insert", c.insert);
+    PrintCounters("erase", c.erase);
+    PrintCounters("find", c.find);
+    PrintCounters("lower_bound", c.lower_bound);
+    std::printf("  rotations %llu single %llu double, vertices %llu allocated %llu freed\n",
+                static_cast<unsigned long long>(c.single_rotations),
+                static_cast<unsigned long long>(c.double_rotations), static_cast<unsigned long long>(c.allocations),
+                static_cast<unsigned long long>(c.deallocations));
+}
+
+// Replays the trace on a sampled set and prints the samples of the timed part.
+template<class K>
+void Profile(const std::vector<TraceRecord<K>>& trace, const ReplayOptions& options) {
+    constexpr size_t kSampledOps = 5;
+    constexpr const char* kSampledNames[kSampledOps] = {"insert", "erase", "find", "lower_bound", "increment"};
+    Set<K, NodeAllocator<K>, SampledSetOptions> s;
+    size_t skip = std::min(options.skip, trace.size());
+    size_t sink = 0;
+    for (size_t i = 0; i < skip; ++i) {
+        sink += Execute(s, trace[i]);
+    }
+    std::vector<SetSample> samples;
+    SetProfiler::Drain(samples);
+    samples.clear();
+    uint64_t dropped = SetProfiler::dropped();
+    uint32_t period = SetProfiler::sample_period();
+    SetProfiler::set_sample_period(options.profile);
+    // Drains well before a ring of SetProfiler::kRingSize samples can fill up.
+    size_t drain_period = SetProfiler::kRingSize / 2 * options.profile;
+    size_t ops = 0;
+    auto start = Clock::now();
+    for (size_t i = skip; i < trace.size(); ++i) {
+        sink += Execute(s, trace[i]);
+        if (++ops % drain_period == 0) {
+            SetProfiler::Drain(samples);
+        }
+    }
+    for (auto it = s.begin(); it != s.end(); ++it) {
+        if (++ops % drain_period == 0) {
+            SetProfiler::Drain(samples);
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    SetProfiler::set_sample_period(period);
+    SetProfiler::Drain(samples);
+    g_sink = sink;
+
+    bench::LatencyHistogram latency[kSampledOps];
+    uint64_t depth[kSampledOps] = {};
+    uint64_t comparisons[kSampledOps] = {};
+    for (const SetSample& sample : samples) {
+        size_t op = static_cast<size_t>(sample.op);
+        latency[op].Record(sample.nanoseconds);
+        depth[op] += sample.depth;
+        comparisons[op] += sample.comparisons;
+    }
+    std::printf("Set sampled 1 in %u, %.3f ms with the final scan, %zu samples, %llu dropped\n", options.profile,
+                ns / 1e6, samples.size(), static_cast<unsigned long long>(SetProfiler::dropped() - dropped));
+    for (size_t op = 0; op < kSampledOps; ++op) {
+        uint64_t n = latency[op].count();
+        if (n != 0) {
+            std::printf("  %-12s %8llu samples %6llu p50 %6llu p99 %8llu max ns %8.2f depth %8.2f comparisons\n",
+                        kSampledNames[op], static_cast<unsigned long long>(n),
+                        static_cast<unsigned long long>(latency[op].Percentile(50)),
+                        static_cast<unsigned long long>(latency[op].Percentile(99)),
+                        static_cast<unsigned long long>(latency[op].max()), static_cast<double>(depth[op]) / n,
+                        static_cast<double>(comparisons[op]) / n);
+        }
+    }
+}
+
+std::string KeyText(const std::string& k) {
+    return k;
+}
+template<class K>
+std::string KeyText(const K& k) {
+    return std::to_string(k);
+}
+
+// Replays the trace on a set counting the accesses and prints the access report of the timed part.
+template<class K>
+void Heatmap(const std::vector<TraceRecord<K>>& trace, const ReplayOptions& options) {
+    Set<K, NodeAllocator<K>, AccessCountingSetOptions> s;
+    size_t skip = std::min(options.skip, trace.size());
+    size_t sink = 0;
+    for (size_t i = 0; i < skip; ++i) {
+        sink += Execute(s, trace[i]);
+    }
+    s.reset_access_counts();
+    for (size_t i = skip; i < trace.size(); ++i) {
+        sink += Execute(s, trace[i]);
+    }
+    g_sink = sink;
+    SetAccessReport<K> report = s.access_report();
+    std::printf("Set access report: %llu accesses of %zu keys (%zu saturated) out of %zu\n",
+                static_cast<unsigned long long>(report.accesses), report.accessed_keys, report.saturated_keys,
+                s.size());
+    std::printf("  mean depth %.2f of the keys, %.2f of the accesses; entropy %.2f bits, at least %.2f comparisons "
+                "per access in an optimal tree\n", report.mean_depth, report.weighted_depth, report.entropy_bits,
+                report.entropy_bits / std::log2(3.0));
+    std::printf("  hottest keys:");
+    for (const auto& key : report.hottest_keys) {
+        std::printf(" %s (%u)", KeyText(key.first).c_str(), key.second);
+    }
+    std::printf("\n  hottest subtrees at depth 4:\n");
+    for (const auto& subtree : report.hottest_subtrees) {
+        std::printf("    %s .. %s: %zu keys, %llu accesses\n", KeyText(subtree.min_key).c_str(),
+                    KeyText(subtree.max_key).c_str(), subtree.keys, static_cast<unsigned long long>(subtree.accesses));
+    }
+}
+
+template<class K>
+void ReplayAll(std::istream& in, const ReplayOptions& options) {
+    std::vector<TraceRecord<K>> trace;
+    size_t count[kOpTypes] = {};
+    TraceReader<K> reader(in);
+    TraceRecord<K> record;
+    while (reader.Read(record)) {
+        if (static_cast<size_t>(record.op) >= kOpTypes) {
+            throw std::runtime_error("corrupted set trace");
+        }
+        ++count[static_cast<size_t>(record.op)];
+        trace.push_back(std::move(record));
+    }
+    std::printf("%zu records:", trace.size());
+    for (size_t op = 0; op < kOpTypes; ++op) {
+        std::printf(" %s %zu", kOpNames[op], count[op]);
+    }
+    std::printf(", %zu skipped\n", std::min(options.skip, trace.size()));
+    std::printf("%-14s %12s %10s %12s\n", "backend", "total ms", "ns/op", "final size");
+
+    Replay<Set<K>, K>("Set", trace, options);
+    Replay<Set<K, NodeAllocator<K>, ParentlessSetOptions>, K>("Set/parentless", trace, options);
+    if (options.profile != 0) {
+        // The sampling overhead is the difference to the Set row; the samples are not drained, a full ring drops them.
+        uint32_t period = SetProfiler::sample_period();
+        SetProfiler::set_sample_period(options.profile);
+        Replay<Set<K, NodeAllocator<K>, SampledSetOptions>, K>("Set/sampled", trace, options);
+        SetProfiler::set_sample_period(period);
+    }
+    Replay<std::set<K>, K>("std::set", trace, options);
+#ifdef SET_BENCH_HAVE_ABSL
+    Replay<absl::btree_set<K>, K>("btree_set", trace, options);
+#endif
+    if (options.counters) {
+        Count(trace, options);
+    }
+    if (options.profile != 0) {
+        Profile(trace, options);
+    }
+    if (options.heatmap) {
+        Heatmap(trace, options);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--skip=", 0) == 0) {
+            options.skip = static_cast<size_t>(std::atof(value.c_str()));
+        } else if (arg.rfind("--repetitions=", 0) == 0) {
+            options.repetitions = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--breakdown") {
+            options.breakdown = true;
+        } else if (arg == "--counters") {
+            options.counters = true;
+        } else if (arg.rfind("--profile=", 0) == 0) {
+            options.profile = static_cast<uint32_t>(std::max(1, std::atoi(value.c_str())));
+        } else if (arg == "--heatmap") {
+            options.heatmap = true;
+        } else if (arg.rfind("--backend=", 0) == 0) {
+            options.backend = value;
+        } else if (arg.rfind("--", 0) != 0 && path.empty()) {
+            path = arg;
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (path.empty()) {
+        std::fprintf(stderr, "usage: %s [--skip=N] [--repetitions=N] [--breakdown] [--counters] [--profile=N] "
+                     "[--heatmap] [--backend=NAME] TRACE\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::fprintf(stderr, "can not open %s\n", path.c_str());
+            return 1;
+        }
+        TraceHeader header = ReadTraceHeader(in);
+        in.seekg(0);
+        if (header.key_kind == TraceKeyKind::kInteger && header.key_size == sizeof(int64_t)) {
+            ReplayAll<int64_t>(in, options);
+        } else if (header.key_kind == TraceKeyKind::kInteger && header.key_size == sizeof(int32_t)) {
+            ReplayAll<int32_t>(in, options);
+        } else if (header.key_kind == TraceKeyKind::kString) {
+            ReplayAll<std::string>(in, options);
+        } else {
+            std::fprintf(stderr, "%s: unsupported key type\n", path.c_str());
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s: %s\n", path.c_str(), e.what());
+        return 1;
+    }
+    return 0;
+}
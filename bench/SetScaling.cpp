@@ -0,0 +1,184 @@
+// Throughput of sets shared by 1 to N threads: Set under a std::mutex, Set under a std::shared_mutex (lookups take it
+// shared) and std::set under a std::mutex. Every thread runs lookups with probability --read_ratio and otherwise
+// inserts or erases (half and half) uniformly random keys of [0, --key_range), so the set holds about half of the
+// range; a small range makes the threads work on the same vertices and cache lines.
+//
+// Usage: set_scaling [--max_threads=N] [--read_ratios=0.5,0.9,0.99] [--key_range=N] [--duration_ms=N]
+//                    [--backend=NAME]
+// Threads go from 1 to --max_threads (the number of hardware threads by default) in powers of 2 plus the maximum.
+// For every point the total throughput and the speedup against one thread are printed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "SetTemplate.h"
+
+namespace {
+
+// Receives the results of the lookups, so that they can not be optimized out.
+std::atomic<uint64_t> g_sink;
+
+struct ScalingOptions {
+    std::vector<double> read_ratios = {0.5, 0.9, 0.99};
+    int64_t key_range = 1000000;
+    int duration_ms = 500;
+    unsigned max_threads = 0;
+    std::string backend;
+};
+
+// The set C behind the lock Mutex. With std::shared_mutex lookups take the lock shared.
+template<class C, class Mutex>
+class LockedSet {
+public:
+    void insert(int64_t k) {
+        std::lock_guard<Mutex> lock(mutex_);
+        set_.insert(k);
+    }
+    void erase(int64_t k) {
+        std::lock_guard<Mutex> lock(mutex_);
+        set_.erase(k);
+    }
+    bool contains(int64_t k) const {
+        if constexpr (std::is_same<Mutex, std::shared_mutex>::value) {
+            std::shared_lock<Mutex> lock(mutex_);
+            return set_.find(k) != set_.end();
+        } else {
+            std::lock_guard<Mutex> lock(mutex_);
+            return set_.find(k) != set_.end();
+        }
+    }
+private:
+    mutable Mutex mutex_;
+    C set_;
+};
+
+// Runs the threads for the given duration, returns the number of operations per second.
+template<class S>
+double Run(S& s, unsigned threads, double read_ratio, const ScalingOptions& options) {
+    std::atomic<unsigned> ready(0);
+    std::atomic<bool> go(false);
+    std::atomic<bool> stop(false);
+    std::vector<uint64_t> ops(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 rng(t + 1);
+            std::uniform_int_distribution<int64_t> keys(0, options.key_range - 1);
+            std::uniform_real_distribution<double> coin(0.0, 1.0);
+            uint64_t done = 0;
+            uint64_t found = 0;
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            // The stop flag is checked every 64 operations, to keep it off the measured path.
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    int64_t k = keys(rng);
+                    double c = coin(rng);
+                    if (c < read_ratio) {
+                        found += s.contains(k);
+                    } else if (c < read_ratio + (1 - read_ratio) / 2) {
+                        s.insert(k);
+                    } else {
+                        s.erase(k);
+                    }
+                }
+                done += 64;
+            }
+            ops[t] = done;
+            g_sink.fetch_add(found, std::memory_order_relaxed);
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.duration_ms));
+    stop.store(true);
+    for (std::thread& w : workers) {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t total = 0;
+    for (uint64_t n : ops) {
+        total += n;
+    }
+    return total / seconds;
+}
+
+template<class C, class Mutex>
+void Measure(const char* backend, const ScalingOptions& options) {
+    if (!options.backend.empty() && options.backend != backend) {
+        return;
+    }
+    std::vector<unsigned> thread_counts;
+    for (unsigned t = 1; t < options.max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(options.max_threads);
+    for (double read_ratio : options.read_ratios) {
+        double single = 0;
+        for (unsigned threads : thread_counts) {
+            LockedSet<C, Mutex> s;
+            std::mt19937_64 rng(0);
+            for (int64_t i = 0; i < options.key_range / 2; ++i) {
+                s.insert(static_cast<int64_t>(rng() % options.key_range));
+            }
+            double throughput = Run(s, threads, read_ratio, options);
+            if (threads == 1) {
+                single = throughput;
+            }
+            std::printf("%-20s %6.2f %8u %12.3f %8.2f\n", backend, read_ratio, threads, throughput / 1e6,
+                        single == 0 ? 0.0 : throughput / single);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ScalingOptions options;
+    options.max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--max_threads=", 0) == 0) {
+            options.max_threads = std::max(1, std::atoi(value.c_str()));
+        } else if (arg.rfind("--read_ratios=", 0) == 0) {
+            options.read_ratios.clear();
+            std::stringstream ratios(value);
+            std::string ratio;
+            while (std::getline(ratios, ratio, ',')) {
+                options.read_ratios.push_back(std::atof(ratio.c_str()));
+            }
+        } else if (arg.rfind("--key_range=", 0) == 0) {
+            options.key_range = std::max<int64_t>(1, static_cast<int64_t>(std::atof(value.c_str())));
+        } else if (arg.rfind("--duration_ms=", 0) == 0) {
+            options.duration_ms = std::atoi(value.c_str());
+        } else if (arg.rfind("--backend=", 0) == 0) {
+            options.backend = value;
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    std::printf("%-20s %6s %8s %12s %8s\n", "backend", "reads", "threads", "Mops/s", "speedup");
+    Measure<Set<int64_t>, std::mutex>("Set+mutex", options);
+    Measure<Set<int64_t>, std::shared_mutex>("Set+shared_mutex", options);
+    Measure<std::set<int64_t>, std::mutex>("std::set+mutex", options);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Writes a synthetic workload as a set trace (SetTrace.h) for set_replay.
+//
+// Usage: set_tracegen --workload=ycsb-a|ycsb-b|ycsb-c|ycsb-d|ycsb-e|window|churn [--key=int64|int32|string]
+//                     [--preload=N] [--operations=N] [--theta=X] [--window=N] [--miss=X] [--seed=N] OUTPUT
+// The options override the preset, see Workload.h. Prints the number of preload records, to be passed to
+// set_replay --skip.
+
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Workload.h"
+
+namespace {
+
+template<class K>
+void WriteTrace(const bench::WorkloadSpec& spec, std::ofstream& out, size_t& records, size_t& preload_records) {
+    TraceWriter<K> writer(out);
+    for (const TraceRecord<K>& record : bench::GenerateWorkload<K>(spec, &preload_records)) {
+        writer.Write(record.op, record.key);
+    }
+    records = writer.records();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string key = "int64";
+    std::string output;
+    try {
+        std::vector<std::string> args;
+        bench::WorkloadSpec spec = bench::ParseWorkloadOptions(argc, argv, nullptr, args);
+        for (const std::string& arg : args) {
+            std::string value = arg.substr(arg.find('=') + 1);
+            if (arg.rfind("--key=", 0) == 0) {
+                key = value;
+            } else if (arg.rfind("--", 0) != 0 && output.empty()) {
+                output = arg;
+            } else {
+                std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+                return 1;
+            }
+        }
+        if (output.empty()) {
+            std::fprintf(stderr, "usage: %s --workload=NAME [--key=int64|int32|string] [options] OUTPUT\n", argv[0]);
+            return 1;
+        }
+
+        std::ofstream out(output, std::ios::binary);
+        if (!out) {
+            std::fprintf(stderr, "can not open %s\n", output.c_str());
+            return 1;
+        }
+        size_t records = 0, preload_records = 0;
+        if (key == "int64") {
+            WriteTrace<int64_t>(spec, out, records, preload_records);
+        } else if (key == "int32") {
+            WriteTrace<int32_t>(spec, out, records, preload_records);
+        } else if (key == "string") {
+            WriteTrace<std::string>(spec, out, records, preload_records);
+        } else {
+            std::fprintf(stderr, "unknown key type %s\n", key.c_str());
+            return 1;
+        }
+        out.close();
+        if (!out) {
+            std::fprintf(stderr, "can not write %s\n", output.c_str());
+            return 1;
+        }
+        std::printf("%s: %zu records, %zu preload records, %s keys\n", output.c_str(), records, preload_records,
+                    key.c_str());
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "BenchUtil.h"
+#include "SetTrace.h"
+
+// Synthetic workloads for the trace tools: YCSB-style operation mixes (Cooper et al., "Benchmarking cloud serving
+// systems with YCSB") over uniform, zipfian or latest key popularity, and sliding windows. Also the execution of trace
+// records and the command line options of the workloads, shared by set_tracegen, set_replay and set_latency.
+
+namespace bench {
+
+// Number and names of the operation types, indexed by SetOp.
+constexpr size_t kOpTypes = 4;
+constexpr const char* kOpNames[kOpTypes] = {"insert", "erase", "find", "lower_bound"};
+
+// Executes one record on a set, returns a value depending on the result, to be summed into a sink.
+template<class C, class K>
+inline size_t Execute(C& c, const TraceRecord<K>& record) {
+    switch (record.op) {
+        case SetOp::kInsert:
+            c.insert(record.key);
+            return 0;
+        case SetOp::kErase:
+            c.erase(record.key);
+            return 0;
+        case SetOp::kFind:
+            return c.find(record.key) != c.end();
+        case SetOp::kLowerBound:
+            return c.lower_bound(record.key) != c.end();
+    }
+    return 0;
+}
+
+enum class Popularity {
+    kUniform,
+    kZipfian,
+    kLatest,  // Zipfian over the insertion order, the most recently inserted key is the most popular one.
+};
+
+struct WorkloadSpec {
+    uint64_t preload = 100000;  // Keys inserted before the operations.
+    uint64_t operations = 1000000;
+    // Shares of the operations, normalized by their sum. Inserts add new keys, erases remove live keys.
+    double find = 1.0;
+    double insert = 0.0;
+    double erase = 0.0;
+    double lower_bound = 0.0;
+    // If true, inserts re-insert live keys instead (YCSB updates; for a set they are lookups, which is what they cost
+    // in a map updating a value in place).
+    bool update = false;
+    // Fraction of the finds, which look for keys that were never inserted.
+    double miss = 0.0;
+    Popularity popularity = Popularity::kZipfian;
+    double theta = 0.99;
+    // If not zero, every insert also erases the key inserted window inserts before, so at most window keys are live
+    // and the popularity applies to the live keys.
+    uint64_t window = 0;
+    uint64_t seed = 42;
+};
+
+// Returns the spec of the named preset: ycsb-a (50% finds, 50% inserts of existing keys, i.e. updates), ycsb-b (95%
+// finds, 5% updates), ycsb-c (finds only), ycsb-d (95% finds of the latest keys, 5% inserts), ycsb-e (95%
+// lower_bound, 5% inserts), window (50% finds, 50% inserts into a sliding window of the preloaded size) or churn (40%
+// finds, 30% inserts, 30% erases, uniform). Throws std::invalid_argument for an unknown name.
+inline WorkloadSpec WorkloadPreset(const std::string& name) {
+    WorkloadSpec spec;
+    if (name == "ycsb-a") {
+        spec.find = 0.5;
+        spec.insert = 0.5;
+        spec.update = true;
+    } else if (name == "ycsb-b") {
+        spec.find = 0.95;
+        spec.insert = 0.05;
+        spec.update = true;
+    } else if (name == "ycsb-c") {
+    } else if (name == "ycsb-d") {
+        spec.find = 0.95;
+        spec.insert = 0.05;
+        spec.popularity = Popularity::kLatest;
+    } else if (name == "ycsb-e") {
+        spec.find = 0.0;
+        spec.lower_bound = 0.95;
+        spec.insert = 0.05;
+    } else if (name == "window") {
+        spec.find = 0.5;
+        spec.insert = 0.5;
+        spec.popularity = Popularity::kUniform;
+        spec.window = spec.preload;
+    } else if (name == "churn") {
+        spec.find = 0.4;
+        spec.insert = 0.3;
+        spec.erase = 0.3;
+        spec.popularity = Popularity::kUniform;
+    } else {
+        throw std::invalid_argument("unknown workload " + name);
+    }
+    return spec;
+}
+
+// Parses the workload options of a command line: --workload=NAME selects a preset (default_preset, or the default
+// spec if it is null, without the option), then --preload=N, --operations=N, --theta=X, --window=N, --miss=X and
+// --seed=N override it. The window of a preset follows --preload unless --window is given. The other arguments are
+// returned in order. Throws std::invalid_argument for an unknown preset.
+inline WorkloadSpec ParseWorkloadOptions(int argc, char** argv, const char* default_preset,
+                                         std::vector<std::string>& others) {
+    WorkloadSpec spec = default_preset == nullptr ? WorkloadSpec() : WorkloadPreset(default_preset);
+    // The preset goes first, the other options override it.
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--workload=", 0) == 0) {
+            spec = WorkloadPreset(arg.substr(arg.find('=') + 1));
+        }
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--workload=", 0) == 0) {
+        } else if (arg.rfind("--preload=", 0) == 0) {
+            bool window_is_preload = spec.window == spec.preload;
+            spec.preload = static_cast<uint64_t>(std::atof(value.c_str()));
+            if (window_is_preload) {
+                spec.window = spec.preload;
+            }
+        } else if (arg.rfind("--operations=", 0) == 0) {
+            spec.operations = static_cast<uint64_t>(std::atof(value.c_str()));
+        } else if (arg.rfind("--theta=", 0) == 0) {
+            spec.theta = std::atof(value.c_str());
+        } else if (arg.rfind("--window=", 0) == 0) {
+            spec.window = static_cast<uint64_t>(std::atof(value.c_str()));
+        } else if (arg.rfind("--miss=", 0) == 0) {
+            spec.miss = std::atof(value.c_str());
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            spec.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else {
+            others.push_back(arg);
+        }
+    }
+    return spec;
+}
+
+// Generates the trace of the workload: spec.preload inserts followed by spec.operations operations. Key i is
+// MakeKey<K>(Scramble(i)), so the insertion order is not the key order. The number of preload records is stored in
+// preload_records if it is not null.
+template<class K>
+std::vector<TraceRecord<K>> GenerateWorkload(const WorkloadSpec& spec, size_t* preload_records = nullptr) {
+    std::mt19937_64 rng(spec.seed);
+    std::vector<TraceRecord<K>> trace;
+    trace.reserve(spec.preload + spec.operations);
+    // live[first, live.size()) are the indices of the live keys in the insertion order (random erases swap the
+    // erased key to the front and disturb it).
+    std::vector<uint64_t> live;
+    size_t first = 0;
+    uint64_t next = 0;
+    auto key = [](uint64_t i) { return MakeKey<K>(Scramble(i)); };
+    auto insert_new = [&]() {
+        trace.push_back({SetOp::kInsert, key(next)});
+        live.push_back(next++);
+        if (spec.window != 0 && live.size() - first > spec.window) {
+            trace.push_back({SetOp::kErase, key(live[first++])});
+        }
+    };
+    for (uint64_t i = 0; i < spec.preload; ++i) {
+        insert_new();
+    }
+    if (preload_records != nullptr) {
+        *preload_records = trace.size();
+    }
+
+    double total = spec.find + spec.insert + spec.erase + spec.lower_bound;
+    if (total <= 0) {
+        throw std::invalid_argument("empty operation mix");
+    }
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    // The zipfian generator takes O(n) to build, it is rebuilt when the number of live keys doubles or halves.
+    uint64_t zipf_n = 0;
+    ZipfGenerator zipf(1, spec.theta);
+    // Returns the position of a live key in live[first, live.size()).
+    auto pick = [&]() -> size_t {
+        uint64_t n = live.size() - first;
+        if (spec.popularity == Popularity::kUniform) {
+            return first + std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+        }
+        if (n > 2 * zipf_n || 2 * n < zipf_n || zipf_n == 0) {
+            zipf_n = n;
+            zipf = ZipfGenerator(zipf_n, spec.theta);
+        }
+        uint64_t rank = std::min(zipf(rng), n - 1);
+        if (spec.popularity == Popularity::kLatest) {
+            return live.size() - 1 - rank;
+        }
+        return first + Scramble(rank) % n;
+    };
+    for (uint64_t i = 0; i < spec.operations; ++i) {
+        double c = coin(rng) * total;
+        if (live.size() == first) {
+            insert_new();
+        } else if ((c -= spec.find) < 0) {
+            if (coin(rng) < spec.miss) {
+                // Inserted indices are below 2^63.
+                trace.push_back({SetOp::kFind, key((uint64_t(1) << 63) | rng())});
+            } else {
+                trace.push_back({SetOp::kFind, key(live[pick()])});
+            }
+        } else if ((c -= spec.insert) < 0) {
+            if (spec.update) {
+                trace.push_back({SetOp::kInsert, key(live[pick()])});
+            } else {
+                insert_new();
+            }
+        } else if ((c -= spec.erase) < 0) {
+            size_t p = pick();
+            trace.push_back({SetOp::kErase, key(live[p])});
+            std::swap(live[p], live[first++]);
+        } else {
+            trace.push_back({SetOp::kLowerBound, key(live[pick()])});
+        }
+    }
+    return trace;
+}
+
+}  // namespace bench
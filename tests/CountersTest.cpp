@@ -0,0 +1,111 @@
+// Tests of the operation counters of CountingSetOptions: calls, depths, rotations and vertex allocations on small
+// known trees, and counting lookups running concurrently.
+
+#include <cstdint>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+using CountingSet = Set<int, NodeAllocator<int>, CountingSetOptions>;
+
+static_assert(sizeof(Set<int>) < sizeof(CountingSet), "a set without counters must not keep them");
+
+// The end vertex is the greatest vertex of the tree, so descending keys are balanced by single rotations only, and a
+// key inserted between the end vertex and its left son makes a zigzag, which takes a double rotation. Every inserted
+// key allocates a vertex, every erased one frees it, duplicates and missing keys are counted as calls only.
+void TestRotationsAndAllocations() {
+    CountingSet descending;
+    for (int k = 3; k >= 1; --k) {
+        descending.insert(k);
+    }
+    SetCounters counters = descending.counters();
+    CHECK(counters.single_rotations == 1 && counters.double_rotations == 0);
+    CHECK(counters.insert.calls == 3 && counters.allocations == 3 && counters.deallocations == 0);
+    for (int k = 0; k >= -1000; --k) {
+        descending.insert(k);
+    }
+    CHECK(descending.counters().double_rotations == 0 && descending.counters().single_rotations > 1);
+
+    CountingSet zigzag;
+    for (int k : {1, 2}) {
+        zigzag.insert(k);
+    }
+    counters = zigzag.counters();
+    CHECK(counters.single_rotations == 0 && counters.double_rotations == 1);
+
+    zigzag.insert(2);
+    zigzag.erase(2);
+    zigzag.erase(5);
+    counters = zigzag.counters();
+    CHECK(counters.insert.calls == 3 && counters.erase.calls == 2);
+    CHECK(counters.allocations == 2 && counters.deallocations == 1);
+    zigzag.reset_counters();
+    counters = zigzag.counters();
+    CHECK(counters.insert.calls == 0 && counters.allocations == 0 && counters.double_rotations == 0);
+}
+
+// Lookups count their calls and comparisons, and descend no deeper than the tree is high.
+void TestLookupCounts() {
+    CountingSet s;
+    for (int k = 0; k < 1000; ++k) {
+        s.insert(k);
+    }
+    s.reset_counters();
+    for (int k = -10; k < 1010; ++k) {
+        s.find(k);
+        s.lower_bound(k);
+    }
+    SetCounters counters = s.counters();
+    size_t height = s.stats().height;
+    CHECK(counters.find.calls == 1020 && counters.lower_bound.calls == 1020);
+    CHECK(counters.find.comparisons >= counters.find.calls && counters.find.max_depth <= height);
+    CHECK(counters.lower_bound.max_depth <= height && counters.lower_bound.mean_depth() > 1.0);
+    CHECK(counters.find.mean_comparisons() <= 2.0 * height);
+    CHECK(counters.insert.calls == 0 && counters.allocations == 0);
+}
+
+// Lookups of a counting set run concurrently under a shared lock, as in set_scaling; the thread sanitizer checks that
+// the counter updates do not race. Counts may be lost, never invented.
+void TestConcurrentCountingReads() {
+    using S = CountingSet;
+    constexpr int kThreads = 4;
+    constexpr int kLookups = 20000;
+    S s;
+    for (int k = 0; k < 1000; ++k) {
+        s.insert(k);
+    }
+    s.reset_counters();
+    std::shared_mutex mutex;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&s, &mutex, t] {
+            for (int i = 0; i < kLookups; ++i) {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                CHECK(s.find((i * 7 + t) % 1000) != s.end());
+                CHECK(*s.lower_bound(i % 1000) == i % 1000);
+                CHECK(s.counters().find.calls <= uint64_t{kThreads} * kLookups);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    SetCounters counters = s.counters();
+    CHECK(counters.find.calls > 0 && counters.find.calls <= uint64_t{kThreads} * kLookups);
+    CHECK(counters.find.max_depth <= s.stats().height);
+    CHECK(counters.insert.calls == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestRotationsAndAllocations();
+    TestLookupCounts();
+    TestConcurrentCountingReads();
+    return 0;
+}
@@ -0,0 +1,29 @@
+// Tests of FixedSet: lookups at compile time and at run time against std::set, and rejected duplicate keys.
+
+#include <set>
+#include <stdexcept>
+
+#include "FixedSet.h"
+#include "TestUtil.h"
+
+namespace {
+
+void TestFixedSet() {
+    static constexpr FixedSet<int, 7> kSet{{13, 2, 7, 40, 5, -3, 11}};
+    static_assert(kSet.find(40) != kSet.end(), "FixedSet::find must work at compile time");
+    static_assert(kSet.find(41) == kSet.end(), "FixedSet::find must work at compile time");
+    std::set<int> model{13, 2, 7, 40, 5, -3, 11};
+    test::CheckSameKeys(kSet, model);
+    for (int k = -5; k < 45; ++k) {
+        test::CheckLookups(kSet, model, k);
+    }
+    int duplicates[] = {1, 2, 1};
+    CHECK_THROWS((FixedSet<int, 3>(duplicates)), std::invalid_argument);
+}
+
+}  // namespace
+
+int main() {
+    TestFixedSet();
+    return 0;
+}
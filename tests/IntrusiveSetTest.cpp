@@ -0,0 +1,99 @@
+// Differential tests of IntrusiveSet against std::set, with member hooks and with base class hooks.
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "IntrusiveSet.h"
+#include "TestUtil.h"
+
+namespace {
+
+struct Item {
+    int key;
+    AvlHook hook;
+    bool operator<(const Item& o) const {
+        return key < o.key;
+    }
+};
+
+void TestIntrusiveSet(uint32_t seed) {
+    constexpr int kKeys = 500;
+    std::vector<Item> items(kKeys);
+    for (int k = 0; k < kKeys; ++k) {
+        items[k].key = k;
+    }
+    using S = IntrusiveSet<Item, &Item::hook>;
+    S s;
+    std::set<int> linked;
+    std::mt19937 rng(seed);
+    for (int i = 0; i < test::kOperations; ++i) {
+        int k = static_cast<int>(rng() % kKeys);
+        if (rng() % 2 == 0) {
+            CHECK(s.insert(items[k]) == linked.insert(k).second);
+        } else if (linked.erase(k) != 0) {
+            s.erase(items[k]);
+        }
+        Item probe{static_cast<int>(rng() % kKeys), AvlHook()};
+        auto found = s.find(probe);
+        CHECK((found != s.end()) == (linked.count(probe.key) != 0));
+        auto bound = s.lower_bound(probe);
+        auto expected = linked.lower_bound(probe.key);
+        CHECK(expected == linked.end() ? bound == s.end() : bound->key == *expected);
+        if (i % test::kCheckPeriod == 0) {
+            CHECK(s.size() == linked.size());
+            auto it = s.begin();
+            for (int key : linked) {
+                CHECK(it->key == key);
+                CHECK(S::iterator_to(items[key]) == it);
+                ++it;
+            }
+            CHECK(it == s.end());
+        }
+    }
+    s.clear();
+    CHECK(s.empty() && s.begin() == s.end());
+}
+
+// An object which is not standard-layout, linked through its AvlHook base.
+class Session : public AvlHook {
+public:
+    explicit Session(int id) : id_(id) {}
+    virtual ~Session() = default;
+    int id() const {
+        return id_;
+    }
+    bool operator<(const Session& o) const {
+        return id_ < o.id_;
+    }
+private:
+    int id_;
+};
+
+void TestIntrusiveSetBaseHook() {
+    std::vector<Session> sessions;
+    for (int id : {5, 1, 4, 2, 3}) {
+        sessions.emplace_back(id);
+    }
+    IntrusiveSet<Session> s;
+    for (Session& session : sessions) {
+        CHECK(s.insert(session));
+    }
+    s.erase(sessions[2]);
+    std::vector<int> ids;
+    for (auto it = s.begin(); it != s.end(); ++it) {
+        ids.push_back(it->id());
+    }
+    CHECK((ids == std::vector<int>{1, 2, 3, 5}));
+    CHECK(s.find(Session(3))->id() == 3 && s.find(Session(4)) == s.end());
+    CHECK(IntrusiveSet<Session>::iterator_to(sessions[0])->id() == 5);
+}
+
+}  // namespace
+
+int main() {
+    TestIntrusiveSet(13);
+    TestIntrusiveSetBaseHook();
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Round trips of MappedSet files, and their rejection of foreign, truncated and corrupted files.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "MappedSet.h"
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+std::string TemporaryPath() {
+    char path[] = "/tmp/mapped_set_test_XXXXXX";
+    int fd = ::mkstemp(path);
+    CHECK(fd >= 0);
+    ::close(fd);
+    return path;
+}
+
+void TestMappedSet() {
+    std::string path = TemporaryPath();
+    for (int n : {0, 1, 2, 3, 15, 16, 17, 1000}) {
+        Set<int> s;
+        std::set<int> model;
+        for (int i = 0; i < n; ++i) {
+            s.insert(3 * i);
+            model.insert(3 * i);
+        }
+        MappedSet<int>::write(path, s);
+        MappedSet<int> mapped(path);
+        CHECK(mapped.verify());
+        test::CheckSameKeys(mapped, model);
+        for (int k = -2; k < 3 * n + 2; ++k) {
+            test::CheckLookups(mapped, model, k);
+        }
+        MappedSet<int> moved(std::move(mapped));
+        CHECK(moved.size() == model.size() && mapped.empty());
+    }
+    std::vector<int> unordered = {1, 3, 2};
+    CHECK_THROWS(MappedSet<int>::write(path, unordered.begin(), unordered.end()), std::invalid_argument);
+
+    Set<int> s{1, 2, 3, 4, 5};
+    MappedSet<int>::write(path, s);
+    CHECK_THROWS(MappedSet<int64_t>{path}, std::runtime_error);
+    std::FILE* f = std::fopen(path.c_str(), "r+b");
+    CHECK(f != nullptr);
+    std::fseek(f, static_cast<long>(sizeof(MappedSetHeader) + 2 * sizeof(int)), SEEK_SET);
+    std::fputc(0x7f, f);
+    std::fclose(f);
+    CHECK(!MappedSet<int>(path).verify());
+    CHECK(::truncate(path.c_str(), sizeof(MappedSetHeader) + 3) == 0);
+    CHECK_THROWS(MappedSet<int>{path}, std::runtime_error);
+    CHECK(::truncate(path.c_str(), 10) == 0);
+    CHECK_THROWS(MappedSet<int>{path}, std::runtime_error);
+    std::remove(path.c_str());
+    CHECK_THROWS(MappedSet<int>{path}, std::runtime_error);
+}
+
+}  // namespace
+
+int main() {
+    TestMappedSet();
+    return 0;
+}
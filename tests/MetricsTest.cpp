@@ -0,0 +1,65 @@
+// Tests of SetMetricsRegistry: registrations and collection running concurrently, and the Prometheus rendering.
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SetMetrics.h"
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+// A thread holding the mutex of a registered set registers and unregisters other sets while another thread collects
+// the metrics; the registry lock is not held while a collector waits for the set mutex, so neither blocks the other.
+void TestMetricsRegistry() {
+    SetMetricsRegistry registry;
+    Set<int, NodeAllocator<int>, CountingSetOptions> guarded{1, 2, 3};
+    std::mutex mutex;
+    SetMetricsRegistry::Registration registration = registry.Register("guarded", guarded, mutex);
+    std::atomic<bool> done{false};
+    std::thread collector([&registry, &done] {
+        while (!done.load()) {
+            CHECK(!registry.Snapshot().empty());
+        }
+    });
+    Set<int> other{4, 5};
+    for (int i = 0; i < 2000; ++i) {
+        std::lock_guard<std::mutex> lock(mutex);
+        guarded.insert(i);
+        std::this_thread::yield();
+        SetMetricsRegistry::Registration temporary = registry.Register("other", other);
+    }
+    done.store(true);
+    collector.join();
+    std::vector<SetMetricsSnapshot> snapshots = registry.Snapshot();
+    CHECK(snapshots.size() == 1 && snapshots[0].name == "guarded" && snapshots[0].stats.size == guarded.size());
+    // The depth histogram counts the keys, not the end vertex.
+    std::string rendered = registry.RenderPrometheus();
+    std::string size = std::to_string(guarded.size());
+    CHECK(rendered.find("set_size{set=\"guarded\"} " + size + "\n") != std::string::npos);
+    CHECK(rendered.find("set_vertex_depth_count{set=\"guarded\"} " + size + "\n") != std::string::npos);
+    SetMetricsRegistry empty_registry;
+    Set<int> empty;
+    SetMetricsRegistry::Registration empty_registration = empty_registry.Register("empty", empty);
+    CHECK(empty_registry.RenderPrometheus().find("set_vertex_depth_count{set=\"empty\"} 0\n") != std::string::npos);
+
+    std::string path = "metrics_test.prom";
+    registry.WritePrometheus(path);
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CHECK(text == registry.RenderPrometheus());
+    std::remove(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    TestMetricsRegistry();
+    return 0;
+}
@@ -0,0 +1,159 @@
+// Tests of NodeAllocator: threads allocating and freeing through their magazines, blocks freed by another thread than
+// the allocating one, sets built and destroyed on different threads, and reservations. The sanitizers check the block
+// reuse.
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "NodeAllocator.h"
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+// A block of its own size class, so that no other test shares its cache.
+struct Block {
+    uint64_t owner;
+    uint64_t index;
+    char payload[40];
+};
+
+constexpr int kThreads = 4;
+constexpr int kBlocks = 20000;
+
+// Every thread allocates blocks, filling them with its own pattern, and frees half of them while it runs. The other
+// half is freed by the next thread, after the owners have exited. No block is handed out twice while it is in use.
+void TestThreadCaches() {
+    std::vector<std::vector<Block*>> kept(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([t, &kept] {
+            NodeAllocator<Block> alloc;
+            std::vector<Block*> blocks;
+            for (int i = 0; i < kBlocks; ++i) {
+                Block* b = alloc.allocate(1);
+                b->owner = static_cast<uint64_t>(t);
+                b->index = static_cast<uint64_t>(i);
+                std::memset(b->payload, t, sizeof(b->payload));
+                blocks.push_back(b);
+            }
+            for (int i = 0; i < kBlocks; ++i) {
+                CHECK(blocks[i]->owner == static_cast<uint64_t>(t) && blocks[i]->index == static_cast<uint64_t>(i));
+                if (i % 2 == 0) {
+                    alloc.deallocate(blocks[i], 1);
+                } else {
+                    kept[t].push_back(blocks[i]);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::set<Block*> distinct;
+    for (int t = 0; t < kThreads; ++t) {
+        for (Block* b : kept[t]) {
+            CHECK(b->owner == static_cast<uint64_t>(t) && b->payload[0] == t);
+            CHECK(reinterpret_cast<uintptr_t>(b) % alignof(Block) == 0);
+            distinct.insert(b);
+        }
+    }
+    CHECK(distinct.size() == static_cast<size_t>(kThreads) * kBlocks / 2);
+    threads.clear();
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&kept, t] {
+            NodeAllocator<Block> alloc;
+            for (Block* b : kept[(t + 1) % kThreads]) {
+                alloc.deallocate(b, 1);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Sets built on one thread are destroyed on another, their vertices go to the magazine of the destroying thread.
+void TestCrossThreadSets() {
+    std::vector<Set<int>> sets(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([t, &sets] {
+            for (int k = 0; k < kBlocks; ++k) {
+                sets[t].insert(k * kThreads + t);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([t, &sets] {
+            Set<int>& s = sets[(t + 1) % kThreads];
+            CHECK(s.size() == static_cast<size_t>(kBlocks) && s.stats().balanced());
+            s = Set<int>();
+            Set<int> rebuilt;
+            for (int k = 0; k < kBlocks; ++k) {
+                rebuilt.insert(k);
+            }
+            CHECK(rebuilt.size() == static_cast<size_t>(kBlocks));
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// A reservation keeps the freed blocks with the thread; shrink_to_fit ends it and returns the free slabs.
+void TestReserve() {
+    struct Reserved {
+        char bytes[72];
+    };
+    constexpr size_t kReserved = 10000;
+    NodeAllocator<Reserved> alloc;
+    alloc.reserve(kReserved);
+    std::vector<Reserved*> blocks;
+    for (int round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < kReserved; ++i) {
+            blocks.push_back(alloc.allocate(1));
+        }
+        for (Reserved* b : blocks) {
+            alloc.deallocate(b, 1);
+        }
+        blocks.clear();
+    }
+    CHECK(alloc.shrink_to_fit() > 0);
+}
+
+// A reserved set churns through its cached vertices and gives them back on shrink_to_fit.
+template<class S>
+void TestReservedSet() {
+    S reserved;
+    reserved.reserve(5000);
+    for (int round = 0; round < 3; ++round) {
+        for (int k = 0; k < 5000; ++k) {
+            reserved.insert(k);
+        }
+        for (int k = 0; k < 5000; k += 1 + round) {
+            reserved.erase(k);
+        }
+    }
+    reserved.shrink_to_fit();
+    CHECK(reserved.stats().balanced() && reserved.stats().vertices == reserved.size());
+}
+
+}  // namespace
+
+int main() {
+    TestThreadCaches();
+    TestCrossThreadSets();
+    TestReserve();
+    TestReservedSet<Set<int>>();
+    TestReservedSet<Set<int, NodeAllocator<int>, ParentlessSetOptions>>();
+    TestReservedSet<Set<int, std::allocator<int>>>();
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Tests of pmr::Set: differential operations on a memory resource, the allocator semantics of copies and moves, and
+// the vertices coming from the given resource.
+
+#include <cstddef>
+#include <memory_resource>
+#include <set>
+#include <utility>
+
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+// Memory resource counting the bytes it hands out and takes back, over the new/delete resource.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocated = 0;
+    size_t deallocated = 0;
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocated += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        deallocated += bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+void TestPmrSet() {
+    std::pmr::monotonic_buffer_resource resource;
+    using S = pmr::Set<int>;
+    S s(&resource);
+    test::RunDifferential(s, [](S& c, int k) { c.insert(k); }, [](S& c, int k) { c.erase(k); }, 500, 7);
+    // The polymorphic allocator does not propagate: a move assignment between resources copies the keys, within one
+    // resource it takes the vertices.
+    std::set<int> model = test::KeysOf<int>(s);
+    std::pmr::monotonic_buffer_resource other_resource;
+    S other({1, 2}, &other_resource);
+    other = std::move(s);
+    test::CheckSameKeys(other, model);
+    S same({3}, &resource);
+    same = std::move(s);
+    CHECK(s.empty());
+    test::CheckSameKeys(same, model);
+}
+
+// The vertices come from the resource of the set and go back to it; a copy uses the default resource unless it is
+// given another allocator.
+void TestPmrResources() {
+    CountingResource resource;
+    {
+        pmr::Set<int> s({1, 2, 3, 4, 5}, &resource);
+        CHECK(resource.allocated > 0);
+        pmr::Set<int> copy(s);
+        CHECK(copy.get_allocator().resource() == std::pmr::get_default_resource());
+        size_t allocated = resource.allocated;
+        pmr::Set<int> copy_here(s, &resource);
+        CHECK(resource.allocated > allocated);
+        test::CheckSameKeys(copy_here, std::set<int>{1, 2, 3, 4, 5});
+    }
+    CHECK(resource.deallocated == resource.allocated);
+}
+
+}  // namespace
+
+int main() {
+    TestPmrSet();
+    TestPmrResources();
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Tests of the sampling profiler: the sample period, the contents of the samples of each operation kind, full rings
+// and the rings of exited threads.
+
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "SetProfiler.h"
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+using SampledSet = Set<int, NodeAllocator<int>, SampledSetOptions>;
+
+// Returns the drained samples of the given kind.
+std::vector<SetSample> DrainOp(SampledOp op) {
+    std::vector<SetSample> all;
+    SetProfiler::Drain(all);
+    std::vector<SetSample> samples;
+    for (const SetSample& sample : all) {
+        if (sample.op == op) {
+            samples.push_back(sample);
+        }
+    }
+    return samples;
+}
+
+// With period 1 every operation of a sampled set is recorded with its set, depth and comparisons, iterator increments
+// without them; a set without sampling records nothing.
+void TestEveryOperation() {
+    SetProfiler::set_sample_period(1);
+    SampledSet s;
+    for (int k = 0; k < 100; ++k) {
+        s.insert(k);
+    }
+    std::vector<SetSample> inserts = DrainOp(SampledOp::kInsert);
+    CHECK(inserts.size() == 100);
+    for (const SetSample& sample : inserts) {
+        CHECK(sample.set == &s && sample.depth > 0 && sample.thread == 0);
+    }
+    for (int k = 0; k < 100; ++k) {
+        s.find(k);
+    }
+    std::vector<SetSample> finds = DrainOp(SampledOp::kFind);
+    CHECK(finds.size() == 100);
+    for (const SetSample& sample : finds) {
+        CHECK(sample.set == &s && sample.comparisons > 0 && sample.depth <= s.stats().height);
+    }
+    s.lower_bound(50);
+    s.erase(50);
+    CHECK(DrainOp(SampledOp::kLowerBound).size() == 1);
+    s.erase(51);
+    CHECK(DrainOp(SampledOp::kErase).size() == 1);
+    for (auto it = s.begin(); it != s.end(); ++it) {
+    }
+    std::vector<SetSample> increments = DrainOp(SampledOp::kIncrement);
+    CHECK(increments.size() == s.size());
+    CHECK(increments[0].set == nullptr && increments[0].depth == 0 && increments[0].comparisons == 0);
+
+    Set<int> plain{1, 2, 3};
+    plain.find(2);
+    std::vector<SetSample> none;
+    CHECK(SetProfiler::Drain(none) == 0);
+}
+
+// Every N-th operation of a thread is sampled.
+void TestPeriod() {
+    SampledSet s{1, 2, 3};
+    SetProfiler::set_sample_period(10);
+    s.find(1);  // Picks up the new period.
+    std::vector<SetSample> samples;
+    SetProfiler::Drain(samples);
+    for (int i = 0; i < 1000; ++i) {
+        s.find(i);
+    }
+    CHECK(DrainOp(SampledOp::kFind).size() == 100);
+}
+
+// A full ring drops the samples and counts them; the rings of exited threads are drained and freed.
+void TestRings() {
+    SampledSet s{1, 2, 3};
+    SetProfiler::set_sample_period(1);
+    for (int i = 0; i < 10; ++i) {
+        s.find(i);  // Runs out the countdown of the old period.
+    }
+    std::vector<SetSample> samples;
+    SetProfiler::Drain(samples);
+    uint64_t dropped = SetProfiler::dropped();
+    for (size_t i = 0; i < SetProfiler::kRingSize + 100; ++i) {
+        s.find(2);
+    }
+    samples.clear();
+    CHECK(SetProfiler::Drain(samples) <= SetProfiler::kRingSize);
+    CHECK(SetProfiler::dropped() >= dropped + 100);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&s] {
+            for (int i = 0; i < 50; ++i) {
+                s.find(i);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::vector<SetSample> finds = DrainOp(SampledOp::kFind);
+    CHECK(finds.size() >= 100);
+    std::vector<uint32_t> per_thread(3, 0);
+    for (const SetSample& sample : finds) {
+        CHECK(sample.thread < 3);
+        ++per_thread[sample.thread];
+    }
+    CHECK(per_thread[1] >= 50 && per_thread[2] >= 50);
+    samples.clear();
+    CHECK(SetProfiler::Drain(samples) == 0);
+}
+
+// Period 0 stops the sampling. The thread checks the period again only after a long countdown, so this runs last.
+void TestStop() {
+    SampledSet s{1, 2, 3};
+    SetProfiler::set_sample_period(0);
+    for (int i = 0; i < 1000; ++i) {
+        s.find(i);
+    }
+    CHECK(DrainOp(SampledOp::kFind).empty());
+}
+
+}  // namespace
+
+int main() {
+    TestEveryOperation();
+    TestPeriod();
+    TestRings();
+    TestStop();
+    return 0;
+}
@@ -0,0 +1,143 @@
+// Differential tests of Set against std::set: random inserts, erases and lookups, checking the contents,
+// find and lower_bound after every operation and the iteration in both directions regularly.
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <set>
+#include <type_traits>
+#include <vector>
+
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+template<class S>
+void TestSet(uint32_t seed) {
+    for (int key_range : {2, 16, 1000}) {
+        S s;
+        test::RunDifferential(s, [](S& c, int k) { c.insert(k); }, [](S& c, int k) { c.erase(k); }, key_range, seed);
+        SetStats stats = s.stats();
+        CHECK(stats.balanced());
+        CHECK(stats.height <= stats.height_bound);
+        CHECK(stats.vertices == s.size());
+        CHECK(stats.wrong_heights == 0);
+        // Copies keep the keys and the balance, the copy assignment replaces the old keys.
+        S copy(s);
+        CHECK(copy.stats().balanced());
+        S assigned{1, 5, 1000000};
+        assigned = s;
+        std::set<int> model = test::KeysOf<int>(s);
+        test::CheckSameKeys(copy, model);
+        test::CheckSameKeys(assigned, model);
+        assigned.insert(-1);
+        CHECK(s.find(-1) == s.end());
+        // The move relinks the end vertex of the set, wherever it is in the tree.
+        S moved(std::move(copy));
+        CHECK(copy.empty() && copy.begin() == copy.end());
+        test::CheckSameKeys(moved, model);
+        CHECK(moved.stats().balanced());
+        moved.insert(1000000);
+        moved.erase(model.empty() ? 0 : *model.rbegin());
+        copy.insert(3);
+        test::CheckSameKeys(copy, std::set<int>{3});
+        // The move assignment takes the vertices and replaces the old keys.
+        std::set<int> moved_model = test::KeysOf<int>(moved);
+        S move_assigned{7, 8};
+        move_assigned = std::move(moved);
+        CHECK(moved.empty() && moved.begin() == moved.end());
+        test::CheckSameKeys(move_assigned, moved_model);
+        move_assigned.insert(-5);
+        CHECK(move_assigned.stats().balanced());
+    }
+}
+
+// Iterators of a parentless set, which keep their path from the root, step in both directions from any lookup result
+// and from end(), as the iterators of a set with parent links do; the vertices are a pointer smaller.
+void TestParentlessIterators() {
+    using S = Set<int, NodeAllocator<int>, ParentlessSetOptions>;
+    std::set<int> model;
+    S s;
+    for (int k = 0; k < 2000; k += 2) {
+        s.insert(k);
+        model.insert(k);
+    }
+    Set<int> linked(model.begin(), model.end());
+    CHECK(s.stats().bytes - sizeof(S) + model.size() * sizeof(void*) == linked.stats().bytes - sizeof(Set<int>));
+    for (int k = -1; k < 2001; ++k) {
+        auto it = s.lower_bound(k);
+        auto expected = model.lower_bound(k);
+        for (int step = 0; step < 3 && expected != model.begin(); ++step) {
+            --it;
+            --expected;
+            CHECK(*it == *expected);
+        }
+        for (int step = 0; step < 6 && expected != model.end(); ++step) {
+            CHECK(it != s.end() && *it == *expected);
+            ++it;
+            ++expected;
+        }
+        if (expected == model.end()) {
+            CHECK(it == s.end());
+        }
+    }
+    auto missing = s.find(1);
+    CHECK(missing == s.end());
+    --missing;
+    CHECK(*missing == *model.rbegin());
+    auto last = s.find(*model.rbegin());
+    ++last;
+    CHECK(last == s.end());
+    --last;
+    CHECK(*last == *model.rbegin());
+}
+
+// Empty sets, default-constructed or moved from, allocate nothing and still have a valid end(); the first insert
+// allocates the first vertex.
+void TestDefaultConstruction() {
+    using S = Set<int, test::ThrowingAllocator<int>>;
+    static_assert(std::is_nothrow_default_constructible<Set<int>>::value, "Set() must not throw");
+    static_assert(std::is_nothrow_default_constructible<S>::value, "Set() must not throw");
+    test::g_allocation_budget = 0;
+    std::vector<S> sets(1000);
+    S moved(std::move(sets[0]));
+    for (const S& s : sets) {
+        CHECK(s.empty() && s.begin() == s.end() && s.find(1) == s.end() && s.lower_bound(1) == s.end());
+    }
+    CHECK(moved.empty() && moved.begin() == moved.end());
+    CHECK_THROWS(sets[1].insert(1), std::bad_alloc);
+    CHECK(sets[1].empty() && sets[1].begin() == sets[1].end());
+    test::g_allocation_budget = 1;
+    sets[1].insert(1);
+    test::g_allocation_budget = -1;
+    test::CheckSameKeys(sets[1], std::set<int>{1});
+}
+
+// A failed copy assignment leaves the set as it was.
+void TestSetAllocationFailures() {
+    using S = Set<int, test::ThrowingAllocator<int>>;
+    S s{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    for (int budget = 0; budget < 10; ++budget) {
+        S target{100, 101, 102};
+        test::g_allocation_budget = budget;
+        CHECK_THROWS(target = s, std::bad_alloc);
+        test::g_allocation_budget = -1;
+        test::CheckSameKeys(target, std::set<int>{100, 101, 102});
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestSet<Set<int>>(1);
+    TestSet<Set<int, NodeAllocator<int>, ParentlessSetOptions>>(2);
+    TestSet<Set<int, NodeAllocator<int>, CountingSetOptions>>(3);
+    TestSet<Set<int, NodeAllocator<int>, SampledSetOptions>>(4);
+    TestSet<Set<int, NodeAllocator<int>, AccessCountingSetOptions>>(5);
+    TestSet<Set<int, std::allocator<int>>>(6);
+    TestParentlessIterators();
+    TestDefaultConstruction();
+    TestSetAllocationFailures();
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Differential tests of SmallSet against std::set, in the inline array and after the promotion to a tree, with moves
+// between the two representations and failed promotions.
+
+#include <cstdint>
+#include <new>
+#include <set>
+#include <type_traits>
+
+#include "SmallSet.h"
+#include "TestUtil.h"
+
+namespace {
+
+template<size_t N>
+void TestSmallSet(uint32_t seed) {
+    using S = SmallSet<int, N>;
+    for (int key_range : {static_cast<int>(N), static_cast<int>(2 * N), 300}) {
+        S s;
+        test::RunDifferential(s, [](S& c, int k) { c.insert(k); }, [](S& c, int k) { c.erase(k); }, key_range, seed);
+        std::set<int> model = test::KeysOf<int>(s);
+        S copy(s);
+        test::CheckSameKeys(copy, model);
+        S assigned;
+        assigned.insert(42);
+        assigned = s;
+        test::CheckSameKeys(assigned, model);
+        // Moves take the keys in either representation and leave the other set empty and usable.
+        S moved(std::move(copy));
+        CHECK(copy.empty() && copy.begin() == copy.end());
+        test::CheckSameKeys(moved, model);
+        S move_assigned{42};
+        move_assigned = std::move(moved);
+        CHECK(moved.empty() && moved.begin() == moved.end());
+        test::CheckSameKeys(move_assigned, model);
+        moved.insert(7);
+        test::CheckSameKeys(moved, std::set<int>{7});
+    }
+    static_assert(std::is_nothrow_move_constructible<S>::value && std::is_nothrow_move_assignable<S>::value,
+                  "SmallSet of int moves without throwing");
+    // Default-constructed iterators compare equal.
+    typename S::iterator first;
+    typename S::iterator second = first;
+    CHECK(first == second);
+}
+
+// A failed promotion or assignment leaves the set as it was, the sanitizers check that nothing leaks or is freed
+// twice.
+void TestSmallSetAllocationFailures() {
+    using S = SmallSet<int, 4, test::ThrowingAllocator<int>>;
+    S small{1, 2, 3, 4};
+    for (int budget = 0; budget < 5; ++budget) {
+        test::g_allocation_budget = budget;
+        CHECK_THROWS(small.insert(5), std::bad_alloc);
+        test::g_allocation_budget = -1;
+        CHECK(!small.is_large());
+        test::CheckSameKeys(small, std::set<int>{1, 2, 3, 4});
+    }
+    S large{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    S large_target{100, 101, 102, 103, 104, 105};
+    for (int budget = 0; budget < 10; ++budget) {
+        S small_target{42};
+        test::g_allocation_budget = budget;
+        CHECK_THROWS(small_target = large, std::bad_alloc);
+        CHECK_THROWS(large_target = large, std::bad_alloc);
+        CHECK_THROWS(S copy(large), std::bad_alloc);
+        test::g_allocation_budget = -1;
+        test::CheckSameKeys(small_target, std::set<int>{42});
+        test::CheckSameKeys(large_target, std::set<int>{100, 101, 102, 103, 104, 105});
+    }
+    small.insert(5);
+    CHECK(small.is_large());
+    large_target = small;
+    test::CheckSameKeys(large_target, std::set<int>{1, 2, 3, 4, 5});
+}
+
+}  // namespace
+
+int main() {
+    TestSmallSet<1>(8);
+    TestSmallSet<8>(9);
+    TestSmallSetAllocationFailures();
+    return 0;
+}
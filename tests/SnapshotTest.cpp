@@ -0,0 +1,176 @@
+// Round trips of Set::save/load, and the rejection of foreign, truncated and corrupted snapshots.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+
+namespace {
+
+template<class S>
+std::string Save(const S& s) {
+    std::ostringstream out;
+    s.save(out);
+    return out.str();
+}
+
+template<class S>
+void Load(S& s, const std::string& bytes) {
+    std::istringstream in(bytes);
+    s.load(in);
+}
+
+template<class S>
+void TestRoundTrip() {
+    // 40000 int keys take several blocks of raw keys.
+    for (int n : {0, 1, 2, 3, 7, 8, 100, 4097, 40000}) {
+        S s;
+        std::set<int> model;
+        for (int i = 0; i < n; ++i) {
+            s.insert(i * 7 - 1000);
+            model.insert(i * 7 - 1000);
+        }
+        // The stream position stays at the end of the snapshot, the following data is not consumed.
+        std::stringstream stream;
+        s.save(stream);
+        stream << "tail";
+        S loaded{1, 2, 3};
+        loaded.load(stream);
+        std::string tail;
+        stream >> tail;
+        CHECK(tail == "tail");
+        test::CheckSameKeys(loaded, model);
+        SetStats stats = loaded.stats();
+        CHECK(stats.balanced() && stats.wrong_heights == 0 && stats.vertices == model.size());
+        // The loaded tree takes further updates like any other.
+        loaded.insert(-2000);
+        loaded.erase(-1000);
+        CHECK(loaded.stats().balanced());
+    }
+}
+
+void TestPmrRoundTrip() {
+    Set<int> s{5, 3, 9};
+    std::pmr::monotonic_buffer_resource resource;
+    pmr::Set<int> loaded(&resource);
+    Load(loaded, Save(s));
+    test::CheckSameKeys(loaded, std::set<int>{3, 5, 9});
+}
+
+void TestStrings() {
+    Set<std::string> s;
+    std::set<std::string> model;
+    for (int i = 0; i < 300; ++i) {
+        std::string k = std::string(i % 41, 'x') + std::to_string(i);
+        s.insert(k);
+        model.insert(k);
+    }
+    Set<std::string> loaded;
+    Load(loaded, Save(s));
+    test::CheckSameKeys(loaded, model);
+}
+
+// Every damaged snapshot is rejected with std::runtime_error and leaves the set unchanged.
+void TestCorruption() {
+    Set<std::string> s;
+    for (int i = 0; i < 50; ++i) {
+        s.insert("key" + std::to_string(1000 + i));
+    }
+    const std::string bytes = Save(s);
+    for (size_t position = 0; position < bytes.size(); ++position) {
+        std::string damaged = bytes;
+        damaged[position] ^= 0x20;
+        Set<std::string> loaded{"old"};
+        CHECK_THROWS(Load(loaded, damaged), std::runtime_error);
+        test::CheckSameKeys(loaded, std::set<std::string>{"old"});
+    }
+    for (size_t size = 0; size < bytes.size(); ++size) {
+        Set<std::string> loaded{"old"};
+        CHECK_THROWS(Load(loaded, bytes.substr(0, size)), std::runtime_error);
+        test::CheckSameKeys(loaded, std::set<std::string>{"old"});
+    }
+    Set<int64_t> other{1, 2};
+    CHECK_THROWS(Load(other, bytes), std::runtime_error);
+    test::CheckSameKeys(other, std::set<int64_t>{1, 2});
+}
+
+// Stream buffer over a string, which can not seek, like a pipe.
+class UnseekableBuffer : public std::streambuf {
+public:
+    explicit UnseekableBuffer(std::string bytes) : bytes_(std::move(bytes)) {
+        setg(&bytes_[0], &bytes_[0], &bytes_[0] + bytes_.size());
+    }
+private:
+    std::string bytes_;
+};
+
+// A damaged key count in the header is rejected before the set is touched, whether the size of the input is known
+// or not.
+template<class K>
+void TestCorruptedCount(const Set<K>& s, const std::set<K>& model) {
+    const std::string bytes = Save(s);
+    for (uint64_t count : {UINT64_MAX, UINT64_MAX - 1, UINT64_MAX / 2, uint64_t{1} << 40, uint64_t{s.size() + 1}}) {
+        std::string damaged = bytes;
+        std::memcpy(&damaged[offsetof(SnapshotHeader, count)], &count, sizeof(count));
+        Set<K> loaded(s);
+        CHECK_THROWS(Load(loaded, damaged), std::runtime_error);
+        test::CheckSameKeys(loaded, model);
+        UnseekableBuffer buffer(damaged);
+        std::istream in(&buffer);
+        Set<K> piped(s);
+        CHECK_THROWS(piped.load(in), std::runtime_error);
+        test::CheckSameKeys(piped, model);
+    }
+}
+
+void TestCorruptedCounts() {
+    Set<std::string> strings{"a", "bb", "ccc"};
+    TestCorruptedCount(strings, std::set<std::string>{"a", "bb", "ccc"});
+    Set<int> ints{1, 2, 3, 4};
+    TestCorruptedCount(ints, std::set<int>{1, 2, 3, 4});
+    // A count too large for the input fails before the set is cleared.
+    std::string damaged = Save(ints);
+    uint64_t count = 1000;
+    std::memcpy(&damaged[offsetof(SnapshotHeader, count)], &count, sizeof(count));
+    Set<int> loaded{7, 8};
+    CHECK_THROWS(Load(loaded, damaged), std::runtime_error);
+    test::CheckSameKeys(loaded, std::set<int>{7, 8});
+}
+
+// A snapshot with a valid checksum whose keys are not increasing.
+void TestUnorderedKeys() {
+    std::string bytes;
+    SnapshotWriter out([&bytes](const char* data, size_t n) { bytes.append(data, n); });
+    SnapshotHeader header = MakeSnapshotHeader<int>(3);
+    out.Write(&header, sizeof(header));
+    int keys[] = {1, 5, 5};
+    out.Write(keys, sizeof(keys));
+    out.Finish();
+    Set<int> loaded{7};
+    CHECK_THROWS(Load(loaded, bytes), std::runtime_error);
+    test::CheckSameKeys(loaded, std::set<int>{7});
+}
+
+
+}  // namespace
+
+int main() {
+    TestRoundTrip<Set<int>>();
+    TestRoundTrip<Set<int, NodeAllocator<int>, ParentlessSetOptions>>();
+    TestRoundTrip<Set<int, std::allocator<int>, CountingSetOptions>>();
+    TestPmrRoundTrip();
+    TestStrings();
+    TestCorruption();
+    TestUnorderedKeys();
+    TestCorruptedCounts();
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Differential tests of StaticSet against std::set, up to and past its capacity, and copies with throwing keys.
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <stdexcept>
+
+#include "StaticSet.h"
+#include "TestUtil.h"
+
+namespace {
+
+template<size_t Capacity>
+void TestStaticSet(uint32_t seed) {
+    using S = StaticSet<int, Capacity>;
+    for (int key_range : {static_cast<int>(Capacity), static_cast<int>(2 * Capacity)}) {
+        S s;
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> key(0, key_range - 1);
+        std::set<int> model;
+        for (int i = 0; i < test::kOperations; ++i) {
+            int k = key(rng);
+            if (rng() % 2 == 0) {
+                InsertResult expected = model.count(k) != 0       ? InsertResult::kExists
+                                        : model.size() == Capacity ? InsertResult::kFull
+                                                                   : InsertResult::kInserted;
+                CHECK(s.insert(k) == expected);
+                if (expected == InsertResult::kInserted) {
+                    model.insert(k);
+                }
+            } else {
+                s.erase(k);
+                model.erase(k);
+            }
+            test::CheckLookups(s, model, key(rng));
+            if (i % test::kCheckPeriod == 0) {
+                test::CheckSameKeys(s, model);
+            }
+        }
+        S copy(s);
+        test::CheckSameKeys(copy, model);
+        S assigned;
+        CHECK(assigned.insert(-1) == InsertResult::kInserted);
+        CHECK(assigned.insert(-1) == InsertResult::kExists);
+        assigned = s;
+        test::CheckSameKeys(assigned, model);
+    }
+    // A full set reports kFull for new keys and kExists for its own ones.
+    S full;
+    for (size_t k = 0; k < Capacity; ++k) {
+        CHECK(full.insert(static_cast<int>(k)) == InsertResult::kInserted);
+    }
+    CHECK(full.insert(-1) == InsertResult::kFull);
+    CHECK(full.insert(0) == InsertResult::kExists);
+    CHECK(full.size() == Capacity);
+}
+
+// Copies left before CopyThrowingKey throws, unlimited if negative, and the number of live keys.
+int g_copy_budget = -1;
+int g_live_keys = 0;
+
+struct CopyThrowingKey {
+    int value;
+    explicit CopyThrowingKey(int v) : value(v) {
+        ++g_live_keys;
+    }
+    CopyThrowingKey(const CopyThrowingKey& key) : value(key.value) {
+        if (g_copy_budget == 0) {
+            throw std::runtime_error("copy");
+        }
+        if (g_copy_budget > 0) {
+            --g_copy_budget;
+        }
+        ++g_live_keys;
+    }
+    ~CopyThrowingKey() {
+        --g_live_keys;
+    }
+    bool operator<(const CopyThrowingKey& key) const {
+        return value < key.value;
+    }
+};
+
+// A throwing key copy destroys the keys copied so far and leaves the target empty; the live key count and the
+// sanitizers check that no key leaks or is destroyed twice.
+void TestStaticSetCopyFailures() {
+    using S = StaticSet<CopyThrowingKey, 16>;
+    {
+        S s;
+        for (int k = 0; k < 10; ++k) {
+            CHECK(s.insert(CopyThrowingKey(k)) == InsertResult::kInserted);
+        }
+        s.erase(CopyThrowingKey(3));
+        for (int budget = 0; budget < 9; ++budget) {
+            S target;
+            CHECK(target.insert(CopyThrowingKey(42)) == InsertResult::kInserted);
+            g_copy_budget = budget;
+            CHECK_THROWS(S copy(s), std::runtime_error);
+            CHECK_THROWS(target = s, std::runtime_error);
+            g_copy_budget = -1;
+            CHECK(target.empty() && target.begin() == target.end());
+            CHECK(target.insert(CopyThrowingKey(7)) == InsertResult::kInserted);
+            target = s;
+            CHECK(target.size() == 9 && target.find(CopyThrowingKey(3)) == target.end());
+        }
+    }
+    CHECK(g_live_keys == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestStaticSet<1>(10);
+    TestStaticSet<64>(11);
+    TestStaticSet<1000>(12);
+    TestStaticSetCopyFailures();
+    return 0;
+}
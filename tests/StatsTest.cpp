@@ -0,0 +1,152 @@
+// Tests of the diagnostics of Set: stats() on trees of known shape and on large ones, the access report
+// and the explained lookups.
+
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include "SetTemplate.h"
+#include "TestUtil.h"
+
+namespace {
+
+struct ParentlessAccessCountingOptions : AccessCountingSetOptions {
+    static constexpr bool kParentLinks = false;
+};
+
+// Descending keys 3, 2, 1 build the tree 3(2(1), end): the keys at depths 0, 1 and 2, the end vertex at depth 1.
+void TestKnownTree() {
+    Set<int> s;
+    for (int k = 3; k >= 1; --k) {
+        s.insert(k);
+    }
+    SetStats stats = s.stats();
+    CHECK(stats.size == 3 && stats.vertices == 3 && stats.height == 3);
+    CHECK((stats.depth_histogram == std::vector<size_t>{1, 1, 1}));
+    CHECK(stats.mean_depth == 1.0);                         // (0 + 1 + 2 + 1) / 4 vertices.
+    CHECK(stats.mean_external_path_length == 12.0 / 5.0);  // 3 + 3 under 1, 2 under 2 and 2 + 2 under the end.
+    CHECK(stats.balance[1] == 2 && stats.balance[0] + stats.balance[2] == 2);
+    CHECK(stats.balance[0] == 0 || stats.balance[2] == 0);
+    CHECK(stats.balanced() && stats.unbalanced == 0 && stats.wrong_heights == 0);
+    CHECK(stats.height <= stats.height_bound);
+    CHECK(stats.bytes > sizeof(Set<int>) && (stats.bytes - sizeof(Set<int>)) % 3 == 0);
+
+    SetStats empty = Set<int>().stats();
+    CHECK(empty.size == 0 && empty.vertices == 0 && empty.height == 1 && empty.depth_histogram.empty());
+    CHECK(empty.mean_depth == 0.0 && empty.mean_external_path_length == 1.0);
+    CHECK(empty.balance[1] == 1 && empty.bytes == sizeof(Set<int>));
+}
+
+// Large trees stay within the AVL height bound, their histograms count every key, and copies keep the heights.
+template<class S>
+void TestLargeTree() {
+    for (int n : {1000, 65535, 100000}) {
+        S s;
+        for (int k = 0; k < n; ++k) {
+            s.insert(k % 2 == 0 ? k : n - k);
+        }
+        SetStats stats = s.stats();
+        CHECK(stats.vertices == s.size() && stats.balanced());
+        CHECK(stats.height <= stats.height_bound);
+        // Only the end vertex may be deeper than all the keys.
+        CHECK(stats.depth_histogram.size() == stats.height || stats.depth_histogram.size() + 1 == stats.height);
+        CHECK(std::accumulate(stats.depth_histogram.begin(), stats.depth_histogram.end(), size_t{0}) == s.size());
+        CHECK(stats.mean_depth < stats.mean_external_path_length);
+        S copy(s);
+        SetStats copied = copy.stats();
+        CHECK(copied.balanced() && copied.height == stats.height && copied.depth_histogram == stats.depth_histogram);
+    }
+}
+
+// On the tree 3(2(1), end) key 1 gets 6 accesses at depth 2 and key 2 gets 2 at depth 1; misses count nothing.
+template<class S>
+void TestAccessReport() {
+    S s;
+    for (int k = 3; k >= 1; --k) {
+        s.insert(k);
+    }
+    for (int i = 0; i < 5; ++i) {
+        s.find(1);
+    }
+    s.lower_bound(0);
+    s.find(2);
+    s.lower_bound(2);
+    s.find(4);
+    s.lower_bound(4);
+    SetAccessReport<int> report = s.access_report(1, 1);
+    CHECK(report.accesses == 8 && report.accessed_keys == 2 && report.saturated_keys == 0);
+    CHECK(report.mean_depth == 1.0 && report.weighted_depth == 14.0 / 8.0);
+    CHECK(std::abs(report.entropy_bits - (-0.75 * std::log2(0.75) - 0.25 * std::log2(0.25))) < 1e-9);
+    CHECK(report.hottest_keys.size() == 1 && report.hottest_keys[0] == std::make_pair(1, 6u));
+    // The only subtree at depth 1 with keys is rooted at 2, the end vertex has no left son.
+    CHECK(report.hottest_subtrees.size() == 1);
+    const SetAccessReport<int>::Subtree& subtree = report.hottest_subtrees[0];
+    CHECK(subtree.min_key == 1 && subtree.max_key == 2 && subtree.keys == 2 && subtree.accesses == 8);
+    CHECK(s.access_report(10, 0).hottest_keys.size() == 2);
+    s.reset_access_counts();
+    report = s.access_report();
+    CHECK(report.accesses == 0 && report.accessed_keys == 0 && report.hottest_keys.empty());
+    CHECK(report.weighted_depth == 0.0 && report.entropy_bits == 0.0);
+}
+
+// Lookups of the tree 3(2(1), end) visit the expected vertices: a left turn costs one comparison, a right turn or a
+// stop two, and the end vertex none.
+template<class S>
+void TestExplainKnownTree() {
+    S s;
+    for (int k = 3; k >= 1; --k) {
+        s.insert(k);
+    }
+    SetExplanation<int> found = s.explain_find(1);
+    CHECK(found.found && found.result == 1 && !found.visited_end);
+    CHECK(found.path.size() == 3 && found.path[0].key == 3 && found.path[1].key == 2 && found.path[2].key == 1);
+    CHECK(found.path[0].comparisons == 1 && found.path[1].comparisons == 1 && found.path[2].comparisons == 2);
+    CHECK(found.comparisons == 4);
+    CHECK(found.path[2].address != found.path[1].address && found.cache_lines >= 1 && found.pages >= 1);
+    CHECK(found.pages <= found.path.size());
+
+    SetExplanation<int> missing = s.explain_find(4);
+    CHECK(!missing.found && !missing.result && missing.visited_end);
+    CHECK(missing.path.size() == 2 && missing.path[0].key == 3 && !missing.path[1].key);
+    CHECK(missing.path[1].comparisons == 0 && missing.comparisons == 2);
+
+    SetExplanation<int> bound = s.explain_lower_bound(0);
+    CHECK(bound.found && bound.result == 1 && bound.path.size() == 3 && !bound.visited_end);
+    SetExplanation<int> past = s.explain_lower_bound(4);
+    CHECK(!past.found && !past.result && past.visited_end);
+}
+
+// An explained lookup makes the comparisons and visits the depth of the counted lookup of the same key.
+void TestExplainMatchesCounters() {
+    Set<int, NodeAllocator<int>, CountingSetOptions> s;
+    for (int k = 0; k < 1000; k += 3) {
+        s.insert(k);
+    }
+    for (int k = -1; k < 1001; ++k) {
+        s.reset_counters();
+        s.find(k);
+        s.lower_bound(k);
+        SetCounters counters = s.counters();
+        SetExplanation<int> found = s.explain_find(k);
+        SetExplanation<int> bound = s.explain_lower_bound(k);
+        CHECK(found.comparisons == counters.find.comparisons && found.path.size() == counters.find.max_depth);
+        CHECK(bound.comparisons == counters.lower_bound.comparisons);
+        CHECK(bound.path.size() == counters.lower_bound.max_depth);
+        CHECK(found.found == (k % 3 == 0 && k < 1000) && bound.found == (k < 1000));
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestKnownTree();
+    TestLargeTree<Set<int>>();
+    TestLargeTree<Set<int, NodeAllocator<int>, ParentlessSetOptions>>();
+    TestAccessReport<Set<int, NodeAllocator<int>, AccessCountingSetOptions>>();
+    TestAccessReport<Set<int, NodeAllocator<int>, ParentlessAccessCountingOptions>>();
+    TestExplainKnownTree<Set<int>>();
+    TestExplainKnownTree<Set<int, NodeAllocator<int>, ParentlessSetOptions>>();
+    TestExplainMatchesCounters();
+    return 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+
+// Minimal checks for the tests, independent of NDEBUG: a failed check prints its location and exits with 1.
+#define CHECK(condition)                                                                      \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            std::exit(1);                                                                     \
+        }                                                                                     \
+    } while (false)
+
+// Expects the statement to throw an exception of the given type.
+#define CHECK_THROWS(statement, exception)                                                                 \
+    do {                                                                                                   \
+        bool thrown = false;                                                                               \
+        try {                                                                                              \
+            statement;                                                                                     \
+        } catch (const exception&) {                                                                       \
+            thrown = true;                                                                                 \
+        }                                                                                                  \
+        if (!thrown) {                                                                                     \
+            std::fprintf(stderr, "%s:%d: %s did not throw %s\n", __FILE__, __LINE__, #statement, #exception); \
+            std::exit(1);                                                                                  \
+        }                                                                                                  \
+    } while (false)
+
+namespace test {
+
+// Returns the keys of the set, in the iteration order.
+template<class K, class C>
+std::set<K> KeysOf(const C& c) {
+    std::set<K> keys;
+    for (auto it = c.begin(); it != c.end(); ++it) {
+        keys.insert(*it);
+    }
+    return keys;
+}
+
+// Checks that the set holds exactly the keys of the model, iterating forwards and backwards.
+template<class C, class K>
+void CheckSameKeys(const C& c, const std::set<K>& model) {
+    CHECK(c.size() == model.size());
+    CHECK(c.empty() == model.empty());
+    auto it = c.begin();
+    for (const K& k : model) {
+        CHECK(it != c.end());
+        CHECK(*it == k);
+        ++it;
+    }
+    CHECK(it == c.end());
+    for (auto m = model.rbegin(); m != model.rend(); ++m) {
+        --it;
+        CHECK(*it == *m);
+    }
+    CHECK(it == c.begin());
+}
+
+// Checks find and lower_bound of the key against the model.
+template<class C, class K>
+void CheckLookups(const C& c, const std::set<K>& model, const K& k) {
+    auto found = c.find(k);
+    if (model.count(k) != 0) {
+        CHECK(found != c.end() && *found == k);
+    } else {
+        CHECK(found == c.end());
+    }
+    auto bound = c.lower_bound(k);
+    auto expected = model.lower_bound(k);
+    if (expected == model.end()) {
+        CHECK(bound == c.end());
+    } else {
+        CHECK(bound != c.end() && *bound == *expected);
+    }
+}
+
+// Operations of a differential run and the period of its full content checks.
+inline constexpr int kOperations = 20000;
+inline constexpr int kCheckPeriod = 97;
+
+// Runs random operations on the container and the model; insert(c, k) and erase(c, k) apply them to the container.
+// Keys are drawn from [0, key_range), so the sizes hover around key_range / 2.
+template<class C, class Insert, class Erase>
+void RunDifferential(C& c, Insert insert, Erase erase, int key_range, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> key(0, key_range - 1);
+    std::set<int> model;
+    for (int i = 0; i < kOperations; ++i) {
+        int k = key(rng);
+        if (rng() % 2 == 0) {
+            insert(c, k);
+            model.insert(k);
+        } else {
+            erase(c, k);
+            model.erase(k);
+        }
+        CHECK(c.size() == model.size());
+        CheckLookups(c, model, key(rng));
+        CheckLookups(c, model, k);
+        if (i % kCheckPeriod == 0) {
+            CheckSameKeys(c, model);
+        }
+    }
+    CheckSameKeys(c, model);
+}
+
+// Allocations left before ThrowingAllocator throws std::bad_alloc, unlimited if negative.
+inline int g_allocation_budget = -1;
+
+template<class T>
+struct ThrowingAllocator {
+    using value_type = T;
+
+    ThrowingAllocator() = default;
+    template<class U>
+    ThrowingAllocator(const ThrowingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (g_allocation_budget == 0) {
+            throw std::bad_alloc();
+        }
+        if (g_allocation_budget > 0) {
+            --g_allocation_budget;
+        }
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        std::allocator<T>().deallocate(p, n);
+    }
+    template<class U>
+    bool operator==(const ThrowingAllocator<U>&) const {
+        return true;
+    }
+    template<class U>
+    bool operator!=(const ThrowingAllocator<U>&) const {
+        return false;
+    }
+};
+
+}  // namespace test
@@ -0,0 +1,132 @@
+// Round trips of set traces: operations recorded by TracedSet and replayed from TraceReader onto another set, with
+// each key encoding, foreign and mismatched headers and damaged records.
+
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SetTemplate.h"
+#include "SetTrace.h"
+#include "TestUtil.h"
+
+namespace {
+
+// Operations recorded from a TracedSet replay onto a plain set into the same keys, in the same order; while the
+// writer is unset nothing is recorded.
+void TestRecordReplay() {
+    std::stringstream stream;
+    TraceWriter<int64_t> writer(stream);
+    TracedSet<int64_t> traced(&writer);
+    std::vector<TraceRecord<int64_t>> expected;
+    for (int64_t i = 0; i < 1000; ++i) {
+        int64_t k = (i * 7919) % 301 - 150;
+        if (i % 5 == 3) {
+            traced.erase(k);
+            expected.push_back({SetOp::kErase, k});
+        } else {
+            traced.insert(k);
+            expected.push_back({SetOp::kInsert, k});
+        }
+        if (i % 4 == 0) {
+            traced.find(-k);
+            expected.push_back({SetOp::kFind, -k});
+            traced.lower_bound(k * (int64_t{1} << 40));
+            expected.push_back({SetOp::kLowerBound, k * (int64_t{1} << 40)});
+        }
+    }
+    traced.set_writer(nullptr);
+    traced.insert(1000000);
+    traced.erase(1000000);
+    CHECK(writer.records() == expected.size());
+
+    std::istringstream in(stream.str());
+    TraceReader<int64_t> reader(in);
+    Set<int64_t> replayed;
+    TraceRecord<int64_t> record;
+    size_t n = 0;
+    while (reader.Read(record)) {
+        CHECK(n < expected.size() && record.op == expected[n].op && record.key == expected[n].key);
+        if (record.op == SetOp::kInsert) {
+            replayed.insert(record.key);
+        } else if (record.op == SetOp::kErase) {
+            replayed.erase(record.key);
+        }
+        ++n;
+    }
+    CHECK(n == expected.size());
+    test::CheckSameKeys(replayed, test::KeysOf<int64_t>(traced));
+}
+
+struct Point {
+    int32_t x;
+    int32_t y;
+};
+
+// Keys without an encoding of their own are copied as is; a trace is only read with the key type it was written with.
+void TestRawKeysAndHeaders() {
+    std::stringstream stream;
+    TraceWriter<Point> writer(stream);
+    writer.Write(SetOp::kFind, Point{-1, 2});
+    std::string bytes = stream.str();
+    CHECK(bytes.size() == sizeof(TraceHeader) + 1 + sizeof(Point));
+    {
+        std::istringstream in(bytes);
+        TraceReader<Point> reader(in);
+        TraceRecord<Point> record;
+        CHECK(reader.Read(record) && record.op == SetOp::kFind && record.key.x == -1 && record.key.y == 2);
+        CHECK(!reader.Read(record));
+    }
+    {
+        std::istringstream in(bytes);
+        CHECK_THROWS(TraceReader<int64_t>{in}, std::runtime_error);
+    }
+    {
+        std::istringstream in(bytes.substr(0, bytes.size() - 1));
+        TraceReader<Point> reader(in);
+        TraceRecord<Point> record;
+        CHECK(!reader.Read(record));
+    }
+    std::istringstream foreign("SETSNAPSHOT and more");
+    CHECK_THROWS(TraceReader<Point>{foreign}, std::runtime_error);
+    std::string future = bytes;
+    future[8] = 2;
+    std::istringstream versioned(future);
+    CHECK_THROWS(TraceReader<Point>{versioned}, std::runtime_error);
+}
+
+// String keys of a trace round-trip; a damaged length ends the trace like a truncation, without allocating it.
+void TestTraceStrings() {
+    std::stringstream stream;
+    TraceWriter<std::string> writer(stream);
+    writer.Write(SetOp::kInsert, "key");
+    writer.Write(SetOp::kFind, std::string(3000000, 'x'));
+    std::string bytes = stream.str();
+    {
+        std::istringstream in(bytes);
+        TraceReader<std::string> reader(in);
+        TraceRecord<std::string> record;
+        CHECK(reader.Read(record) && record.op == SetOp::kInsert && record.key == "key");
+        CHECK(reader.Read(record) && record.op == SetOp::kFind && record.key.size() == 3000000);
+        CHECK(!reader.Read(record));
+    }
+    std::string damaged = bytes.substr(0, sizeof(TraceHeader));
+    damaged += static_cast<char>(SetOp::kFind);
+    damaged += std::string(9, '\xff') + '\x01';  // A length of 2^64 - 1.
+    damaged += "abc";
+    std::istringstream in(damaged);
+    TraceReader<std::string> reader(in);
+    TraceRecord<std::string> record;
+    CHECK(!reader.Read(record));
+}
+
+}  // namespace
+
+int main() {
+    TestRecordReplay();
+    TestRawKeysAndHeaders();
+    TestTraceStrings();
+    return 0;
+}